@@ -0,0 +1,499 @@
+#include <webkit2/webkit2.h>
+#include <gtk/gtk.h>
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Launching another game activates the running host over D-Bus, so every
+// game window shares one UI process and one web process.
+#define APP_ID "org.vynos.Games"
+
+// Where `make install` puts the games. VYN_GAMES_DIR overrides it, which is
+// how `make bench` runs the games from the source tree.
+#ifndef GAMES_DIR
+#define GAMES_DIR "/usr/local/share/games"
+#endif
+
+typedef struct {
+    const char *id;                // Command line name
+    const char *name;              // Directory under GAMES_DIR and display name
+} Game;
+
+// The games are known at build time, so startup never scans directories.
+static const Game games[] = {
+    { "robodump", "RoboDump" },
+    { "tictacwar", "TicTacWar" },
+};
+
+// --startup-trace state for one launch, attached to its web view as
+// "vyn-trace"
+typedef struct {
+    GApplicationCommandLine *command_line;
+    gint64 start;
+    gboolean exit_after_load;
+    gulong draw_handler;
+} StartupTrace;
+
+static WebKitWebContext *web_context;
+static gint64 process_start;
+
+static GtkWidget *create_window(GtkApplication *app, const Game *game, StartupTrace *trace);
+
+static const char *
+games_dir(void)
+{
+    const char *dir = g_getenv("VYN_GAMES_DIR");
+    return dir && *dir ? dir : GAMES_DIR;
+}
+
+static const Game *
+find_game(const char *id)
+{
+    for (gsize i = 0; i < G_N_ELEMENTS(games); i++) {
+        if (g_ascii_strcasecmp(games[i].id, id) == 0 || g_ascii_strcasecmp(games[i].name, id) == 0)
+            return &games[i];
+    }
+    return NULL;
+}
+
+// Resident memory of a process and everything it started, in kilobytes.
+// The web and network processes are children of the host.
+static gint64
+process_tree_rss(const char *pid)
+{
+    char *path = g_strdup_printf("/proc/%s/status", pid);
+    char *contents = NULL;
+    gint64 rss = 0;
+    GDir *tasks;
+    
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        const char *line = strstr(contents, "\nVmRSS:");
+        if (line)
+            rss = g_ascii_strtoll(line + strlen("\nVmRSS:"), NULL, 10);
+    }
+    g_free(contents);
+    g_free(path);
+    
+    path = g_strdup_printf("/proc/%s/task", pid);
+    tasks = g_dir_open(path, 0, NULL);
+    g_free(path);
+    if (!tasks)
+        return rss;
+    for (const char *task; (task = g_dir_read_name(tasks));) {
+        char **children;
+        
+        path = g_strdup_printf("/proc/%s/task/%s/children", pid, task);
+        contents = NULL;
+        g_file_get_contents(path, &contents, NULL, NULL);
+        g_free(path);
+        if (!contents)
+            continue;
+        children = g_strsplit(g_strstrip(contents), " ", -1);
+        for (int i = 0; children[i]; i++) {
+            if (*children[i])
+                rss += process_tree_rss(children[i]);
+        }
+        g_strfreev(children);
+        g_free(contents);
+    }
+    g_dir_close(tasks);
+    return rss;
+}
+
+static void
+startup_trace(WebKitWebView *view, const char *event)
+{
+    StartupTrace *trace = g_object_get_data(G_OBJECT(view), "vyn-trace");
+    if (trace)
+        g_application_command_line_printerr(trace->command_line, "[startup] %8.2f ms  %s\n",
+                                            (g_get_monotonic_time() - trace->start) / 1000.0, event);
+}
+
+static void
+startup_trace_free(gpointer data)
+{
+    StartupTrace *trace = data;
+    g_object_unref(trace->command_line);
+    g_free(trace);
+}
+
+// Report memory once the web process has settled after the first paint.
+static gboolean
+trace_memory(gpointer user_data)
+{
+    WebKitWebView *view = user_data;
+    StartupTrace *trace = g_object_get_data(G_OBJECT(view), "vyn-trace");
+    char *self = g_strdup_printf("%d", getpid());
+    
+    g_application_command_line_printerr(trace->command_line, "[memory]  %8.1f MB  host and web processes\n",
+                                        process_tree_rss(self) / 1024.0);
+    g_free(self);
+    if (trace->exit_after_load)
+        gtk_widget_destroy(gtk_widget_get_toplevel(GTK_WIDGET(view)));
+    g_object_unref(view);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_trace_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)cr;
+    (void)user_data;
+    
+    StartupTrace *trace = g_object_get_data(G_OBJECT(widget), "vyn-trace");
+    
+    g_signal_handler_disconnect(widget, trace->draw_handler);
+    trace->draw_handler = 0;
+    startup_trace(WEBKIT_WEB_VIEW(widget), "first paint after load");
+    g_timeout_add_seconds(1, trace_memory, g_object_ref(widget));
+    return FALSE;
+}
+
+static void
+on_load_changed(WebKitWebView *view, WebKitLoadEvent event, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    StartupTrace *trace = g_object_get_data(G_OBJECT(view), "vyn-trace");
+    
+    if (!trace)
+        return;
+    if (event == WEBKIT_LOAD_COMMITTED) {
+        startup_trace(view, "page committed (web process running)");
+    } else if (event == WEBKIT_LOAD_FINISHED && !trace->draw_handler) {
+        startup_trace(view, "page loaded");
+        trace->draw_handler = g_signal_connect_after(view, "draw", G_CALLBACK(on_trace_draw), NULL);
+        gtk_widget_queue_draw(GTK_WIDGET(view));
+    }
+}
+
+static void
+on_title_changed(GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)pspec;
+    
+    const char *title = webkit_web_view_get_title(WEBKIT_WEB_VIEW(object));
+    const Game *game = user_data;
+    gtk_window_set_title(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(object))),
+                         title && *title ? title : game->name);
+}
+
+// Whether a URI is a file inside the game's own directory.
+static gboolean
+game_owns_uri(const Game *game, const char *uri)
+{
+    char *path = g_filename_from_uri(uri, NULL, NULL);
+    char *dir = g_build_filename(games_dir(), game->name, NULL);
+    char *canonical_dir = g_canonicalize_filename(dir, NULL);
+    char *prefix = g_strconcat(canonical_dir, G_DIR_SEPARATOR_S, NULL);
+    char *canonical = path ? g_canonicalize_filename(path, NULL) : NULL;
+    gboolean owned = canonical && g_str_has_prefix(canonical, prefix);
+    
+    g_free(canonical);
+    g_free(prefix);
+    g_free(canonical_dir);
+    g_free(dir);
+    g_free(path);
+    return owned;
+}
+
+// Keep the view on the game: links and scripts cannot navigate it away
+// from the game's directory or open windows.
+static gboolean
+on_decide_policy(WebKitWebView *view, WebKitPolicyDecision *decision,
+                 WebKitPolicyDecisionType type, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)view;
+    
+    const Game *game = user_data;
+    WebKitNavigationAction *action;
+    const char *uri;
+    
+    if (type == WEBKIT_POLICY_DECISION_TYPE_RESPONSE)
+        return FALSE;
+    if (type == WEBKIT_POLICY_DECISION_TYPE_NEW_WINDOW_ACTION) {
+        webkit_policy_decision_ignore(decision);
+        return TRUE;
+    }
+    action = webkit_navigation_policy_decision_get_navigation_action(WEBKIT_NAVIGATION_POLICY_DECISION(decision));
+    uri = webkit_uri_request_get_uri(webkit_navigation_action_get_request(action));
+    if (!g_str_equal(uri, "about:blank") && !game_owns_uri(game, uri)) {
+        webkit_policy_decision_ignore(decision);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// No browser context menu
+static gboolean
+on_context_menu(WebKitWebView *view, WebKitContextMenu *menu, GdkEvent *event,
+                WebKitHitTestResult *hit, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)view;
+    (void)menu;
+    (void)event;
+    (void)hit;
+    (void)user_data;
+    
+    return TRUE;
+}
+
+static gboolean
+on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    GtkWindow *window = GTK_WINDOW(widget);
+    guint state = event->state & gtk_accelerator_get_default_mod_mask();
+    
+    // F11 toggles fullscreen, Ctrl+Q closes the game
+    if (event->keyval == GDK_KEY_F11 && state == 0) {
+        GdkWindow *gdk_window = gtk_widget_get_window(widget);
+        if (gdk_window_get_state(gdk_window) & GDK_WINDOW_STATE_FULLSCREEN)
+            gtk_window_unfullscreen(window);
+        else
+            gtk_window_fullscreen(window);
+        return TRUE;
+    }
+    if (state == GDK_CONTROL_MASK && gdk_keyval_to_lower(event->keyval) == GDK_KEY_q) {
+        gtk_widget_destroy(widget);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// One context for every game. Only local storage (high scores) is kept on
+// disk; there is no HTTP cache, cookie jar, favicon database or session
+// state to read at startup or write while playing.
+static void
+web_context_init(void)
+{
+    char *data_dir = g_build_filename(g_get_user_data_dir(), "vyn-games", NULL);
+    char *cache_dir = g_build_filename(g_get_user_cache_dir(), "vyn-games", NULL);
+    WebKitWebsiteDataManager *manager = webkit_website_data_manager_new("base-data-directory", data_dir,
+                                                                       "base-cache-directory", cache_dir,
+                                                                       NULL);
+    
+    web_context = webkit_web_context_new_with_website_data_manager(manager);
+    webkit_web_context_set_cache_model(web_context, WEBKIT_CACHE_MODEL_DOCUMENT_VIEWER);
+    webkit_web_context_set_spell_checking_enabled(web_context, FALSE);
+    
+    g_object_unref(manager);
+    g_free(cache_dir);
+    g_free(data_dir);
+}
+
+// Windows after the first share its web process through a related view.
+static WebKitWebView *
+new_web_view(GtkApplication *app)
+{
+    WebKitWebView *related = NULL;
+    WebKitSettings *settings;
+    WebKitWebView *view;
+    
+    for (GList *l = gtk_application_get_windows(app); l && !related; l = l->next) {
+        GtkWidget *child = gtk_bin_get_child(GTK_BIN(l->data));
+        if (WEBKIT_IS_WEB_VIEW(child))
+            related = WEBKIT_WEB_VIEW(child);
+    }
+    if (related)
+        view = WEBKIT_WEB_VIEW(webkit_web_view_new_with_related_view(related));
+    else
+        view = WEBKIT_WEB_VIEW(g_object_new(WEBKIT_TYPE_WEB_VIEW, "web-context", web_context, NULL));
+    
+    settings = webkit_web_view_get_settings(view);
+    // Pages load their images with <img> and CSS, which needs no file
+    // access from scripts
+    webkit_settings_set_allow_file_access_from_file_urls(settings, FALSE);
+    webkit_settings_set_enable_page_cache(settings, FALSE);
+    webkit_settings_set_enable_developer_extras(settings, FALSE);
+    webkit_settings_set_enable_smooth_scrolling(settings, FALSE);
+    webkit_settings_set_javascript_can_open_windows_automatically(settings, FALSE);
+    
+    return view;
+}
+
+static GtkWidget *
+create_window(GtkApplication *app, const Game *game, StartupTrace *trace)
+{
+    GtkWidget *window;
+    WebKitWebView *view = new_web_view(app);
+    char *path = g_build_filename(games_dir(), game->name, "index.html", NULL);
+    char *uri = g_filename_to_uri(path, NULL, NULL);
+    char *icon = g_build_filename(games_dir(), game->name, "icon.png", NULL);
+    
+    if (trace)
+        g_object_set_data_full(G_OBJECT(view), "vyn-trace", trace, startup_trace_free);
+    g_signal_connect(view, "load-changed", G_CALLBACK(on_load_changed), NULL);
+    g_signal_connect(view, "notify::title", G_CALLBACK(on_title_changed), (gpointer)game);
+    g_signal_connect(view, "decide-policy", G_CALLBACK(on_decide_policy), (gpointer)game);
+    g_signal_connect(view, "context-menu", G_CALLBACK(on_context_menu), NULL);
+    
+    // Start the web process loading the game before the window is realized
+    webkit_web_view_load_uri(view, uri);
+    startup_trace(view, "load started");
+    
+    // Create window, fullscreen like the kiosk launchers were
+    window = gtk_application_window_new(app);
+    gtk_window_set_title(GTK_WINDOW(window), game->name);
+    gtk_window_set_default_size(GTK_WINDOW(window), 1024, 768);
+    gtk_window_set_icon_from_file(GTK_WINDOW(window), icon, NULL);
+    gtk_window_fullscreen(GTK_WINDOW(window));
+    gtk_container_add(GTK_CONTAINER(window), GTK_WIDGET(view));
+    g_signal_connect(window, "key-press-event", G_CALLBACK(on_key_press), NULL);
+    
+    // Show all widgets
+    gtk_widget_show_all(window);
+    gtk_widget_grab_focus(GTK_WIDGET(view));
+    startup_trace(view, "window shown");
+    
+    g_free(icon);
+    g_free(uri);
+    g_free(path);
+    return window;
+}
+
+static void
+on_game_chosen(GtkButton *button, gpointer user_data)
+{
+    GtkWidget *chooser = gtk_widget_get_toplevel(GTK_WIDGET(button));
+    create_window(gtk_window_get_application(GTK_WINDOW(chooser)), user_data, NULL);
+    gtk_widget_destroy(chooser);
+}
+
+// A window with a button per game, for launches that name none.
+static void
+create_chooser(GtkApplication *app)
+{
+    GtkWidget *window = gtk_application_window_new(app);
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 12);
+    
+    gtk_window_set_title(GTK_WINDOW(window), "Vyn Games");
+    gtk_window_set_resizable(GTK_WINDOW(window), FALSE);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 24);
+    gtk_container_add(GTK_CONTAINER(window), box);
+    
+    for (gsize i = 0; i < G_N_ELEMENTS(games); i++) {
+        char *icon = g_build_filename(games_dir(), games[i].name, "icon.png", NULL);
+        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_size(icon, 96, 96, NULL);
+        GtkWidget *button = gtk_button_new_with_label(games[i].name);
+        
+        if (pixbuf) {
+            gtk_button_set_image(GTK_BUTTON(button), gtk_image_new_from_pixbuf(pixbuf));
+            gtk_button_set_image_position(GTK_BUTTON(button), GTK_POS_TOP);
+            gtk_button_set_always_show_image(GTK_BUTTON(button), TRUE);
+            g_object_unref(pixbuf);
+        }
+        g_signal_connect(button, "clicked", G_CALLBACK(on_game_chosen), (gpointer)&games[i]);
+        gtk_box_pack_start(GTK_BOX(box), button, TRUE, TRUE, 0);
+        g_free(icon);
+    }
+    
+    gtk_widget_show_all(window);
+}
+
+// --list runs locally instead of being forwarded to a running host.
+static gint
+on_handle_local_options(GApplication *app, GVariantDict *options, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)app;
+    (void)user_data;
+    
+    if (!g_variant_dict_contains(options, "list"))
+        return -1;
+    for (gsize i = 0; i < G_N_ELEMENTS(games); i++)
+        g_print("%-12s %s\n", games[i].id, games[i].name);
+    return 0;
+}
+
+// Runs once, in the primary instance only.
+static void
+on_startup(GApplication *app, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)app;
+    (void)user_data;
+    
+    web_context_init();
+}
+
+// Runs in the primary instance for every launch, including ones forwarded
+// from other processes.
+static int
+on_command_line(GApplication *app, GApplicationCommandLine *command_line, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    GVariantDict *options = g_application_command_line_get_options_dict(command_line);
+    gchar **arguments = NULL;
+    StartupTrace *trace = NULL;
+    const Game *game;
+    
+    g_variant_dict_lookup(options, G_OPTION_REMAINING, "^as", &arguments);
+    if (!arguments || !arguments[0]) {
+        create_chooser(GTK_APPLICATION(app));
+        g_strfreev(arguments);
+        return 0;
+    }
+    
+    game = find_game(arguments[0]);
+    if (!game) {
+        g_application_command_line_printerr(command_line, "Unknown game '%s' (see --list)\n", arguments[0]);
+        g_strfreev(arguments);
+        return 1;
+    }
+    g_strfreev(arguments);
+    
+    if (g_variant_dict_contains(options, "startup-trace")) {
+        trace = g_new0(StartupTrace, 1);
+        trace->command_line = g_object_ref(command_line);
+        // A forwarded launch is timed from its arrival here
+        trace->start = g_application_command_line_get_is_remote(command_line) ?
+            g_get_monotonic_time() : process_start;
+        trace->exit_after_load = g_variant_dict_contains(options, "exit-after-load");
+    }
+    create_window(GTK_APPLICATION(app), game, trace);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    GtkApplication *app;
+    int status;
+    
+    process_start = g_get_monotonic_time();
+    
+    const GOptionEntry entries[] = {
+        { "list", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "List the installed games, then exit", NULL },
+        { "startup-trace", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Report time to window, load and first paint, and memory use", NULL },
+        { "exit-after-load", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "With --startup-trace, close the game once it has been measured", NULL },
+        { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, NULL, NULL, "[GAME]" },
+        { NULL }
+    };
+    
+    app = gtk_application_new(APP_ID, G_APPLICATION_HANDLES_COMMAND_LINE);
+    g_application_add_main_option_entries(G_APPLICATION(app), entries);
+    g_application_set_option_context_summary(G_APPLICATION(app), "Play a Vyn game. With no GAME, pick one.");
+    g_signal_connect(app, "handle-local-options", G_CALLBACK(on_handle_local_options), NULL);
+    g_signal_connect(app, "startup", G_CALLBACK(on_startup), NULL);
+    g_signal_connect(app, "command-line", G_CALLBACK(on_command_line), NULL);
+    
+    // Start main loop; returns when the last window closes
+    status = g_application_run(G_APPLICATION(app), argc, argv);
+    g_object_unref(app);
+    g_clear_object(&web_context);
+    
+    return status;
+}
@@ -0,0 +1,97 @@
+# Build profiles shared by the app Makefiles. Each Makefile sets APP (the
+# binary, built from $(APP).c), PKGS (its pkg-config packages) and
+# WORKLOAD, a headless command run as $(call WORKLOAD,binary) to train
+# PGO and to time the profiles against each other, then includes this.
+#
+#   make                     release: -O2, LTO, for MARCH
+#   make PROFILE=debug       no optimization, full debug info
+#   make PROFILE=pgo         release trained on WORKLOAD; build it as your
+#                            user, then sudo make install PROFILE=pgo
+#   make compare             size and WORKLOAD time of all three
+#
+# MARCH defaults to x86-64-v2, a baseline every machine we ship to runs, so
+# a binary built on a newer box still starts there. MARCH=native tunes for
+# the build machine only, for binaries that never leave it.
+
+CC = gcc
+PROFILE ?= release
+MARCH ?= x86-64-v2
+PGO_DIR = $(CURDIR)/.pgo
+COMPARE_RUNS ?= 3
+
+WARNINGS = -Wall -Wextra
+DEBUG_FLAGS = -O0 -g
+RELEASE_FLAGS = -O2 -march=$(MARCH) -flto=auto
+# Training runs are multi-threaded; atomic updates keep the counters sane
+PGO_GENERATE = -fprofile-generate=$(PGO_DIR) -fprofile-update=atomic
+# Code the workload never reaches is optimized as in release, not for size
+PGO_USE = -fprofile-use=$(PGO_DIR) -fprofile-partial-training -Wno-missing-profile
+
+ifeq ($(PROFILE),debug)
+PROFILE_FLAGS = $(DEBUG_FLAGS)
+else ifeq ($(PROFILE),release)
+PROFILE_FLAGS = $(RELEASE_FLAGS)
+else ifeq ($(PROFILE),pgo)
+PROFILE_FLAGS = $(RELEASE_FLAGS) $(PGO_USE)
+PGO_DATA = $(PGO_DIR)/trained
+else
+$(error PROFILE must be debug, release or pgo)
+endif
+
+CFLAGS = $(WARNINGS) $(PROFILE_FLAGS) `pkg-config --cflags $(PKGS)`
+LDFLAGS = `pkg-config --libs $(PKGS)`
+
+# Rebuild when the profile or its flags change, not only the source
+PROFILE_STAMP = .build-profile
+$(shell echo '$(PROFILE_FLAGS)' | cmp -s - $(PROFILE_STAMP) || echo '$(PROFILE_FLAGS)' > $(PROFILE_STAMP))
+
+.DEFAULT_GOAL := all
+
+$(APP): $(PROFILE_STAMP) $(PGO_DATA)
+
+# GCC names profile data after the output file, so the instrumented binary
+# is built as $(APP) itself and replaced by the final build afterwards.
+$(PGO_DIR)/trained: $(APP).c
+	@if [ "`id -u`" = 0 ]; then \
+		echo "Not training as root: run make PROFILE=pgo as your user, then install" >&2; exit 1; fi
+	rm -rf $(PGO_DIR)
+	mkdir -p $(PGO_DIR)
+	$(CC) $(WARNINGS) $(RELEASE_FLAGS) $(PGO_GENERATE) `pkg-config --cflags $(PKGS)` \
+		-o $(APP) $(APP).c $(LDFLAGS)
+	$(call WORKLOAD,./$(APP))
+	touch $@
+
+# Each profile is built into .profiles/, then WORKLOAD is run COMPARE_RUNS
+# times per binary and the fastest run is kept. Sizes are of the unstripped
+# file and of its code (text) segment.
+compare:
+	rm -rf .profiles
+	mkdir -p .profiles
+	for profile in debug release pgo; do \
+		$(MAKE) --no-print-directory PROFILE=$$profile $(APP) && \
+		cp $(APP) .profiles/$(APP)-$$profile || exit 1; \
+	done
+	@for profile in debug release pgo; do \
+		bin=.profiles/$(APP)-$$profile; best=; \
+		echo "Running the workload with the $$profile build..."; \
+		for run in `seq $(COMPARE_RUNS)`; do \
+			start=`date +%s%N`; \
+			($(call WORKLOAD,$$bin)) > .profiles/$$profile.log 2>&1 || \
+				{ cat .profiles/$$profile.log; exit 1; }; \
+			ms=$$(( (`date +%s%N` - start) / 1000000 )); \
+			if [ -z "$$best" ] || [ $$ms -lt $$best ]; then best=$$ms; fi; \
+		done; \
+		echo "$$profile `stat -c %s $$bin` `size $$bin | awk 'NR == 2 { print $$1 }'` $$best" >> .profiles/report; \
+	done
+	@echo
+	@awk 'BEGIN { printf "%-8s %10s %10s %10s %8s\n", "profile", "file KB", "text KB", "time ms", "speed" } \
+		{ name[NR] = $$1; file[NR] = $$2; text[NR] = $$3; ms[NR] = $$4; if ($$1 == "release") base = $$4 } \
+		END { for (i = 1; i <= NR; i++) \
+			printf "%-8s %10.1f %10.1f %10d %7.2fx\n", name[i], file[i] / 1024, text[i] / 1024, ms[i], base / ms[i] }' \
+		.profiles/report
+	@echo "Speed is relative to release. Workload output is in .profiles/<profile>.log."
+
+clean-profiles:
+	rm -rf $(PGO_DIR) .profiles $(PROFILE_STAMP)
+
+.PHONY: compare clean-profiles
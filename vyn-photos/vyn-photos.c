@@ -1,10 +1,59 @@
 #include <gtk/gtk.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
-// Define the application structure
+// Perceptual hash index settings
+#define HASH_SIZE 32                    // Images are decoded this small for hashing
+#define DUPLICATE_PHASH_DISTANCE 10     // pHash bits near-duplicates may differ in
+#define DUPLICATE_DHASH_DISTANCE 14     // dHash bits, checked to weed out pHash collisions
+#define INDEX_CHUNKS 4                  // Hashes are indexed as four 16-bit keys
+#define INDEX_CHUNK_RADIUS (DUPLICATE_PHASH_DISTANCE / INDEX_CHUNKS)
+
+// Eight floats handled per operation; GCC maps this onto SSE, AVX or NEON
+typedef float v8f __attribute__((vector_size(32)));
+
+typedef struct _VynPhotosApp VynPhotosApp;
+
+// Perceptual hashes of a folder's images, built on a background thread.
+// The arrays are indexed by position in paths, which follows image_list.
 typedef struct {
+    VynPhotosApp *app;          // NULL when run headless
+    gchar *dir_path;
+    GPtrArray *paths;
+    GHashTable *positions;      // Path -> position + 1
+    guint64 *phash;
+    guint64 *dhash;
+    gint64 *mtime;
+    gint64 *size;
+    gboolean *hashed;           // FALSE for files that failed to decode
+    guint cached;               // Hashes taken from the cache
+    gboolean cache_dirty;
+    guint32 *offsets[INDEX_CHUNKS];     // Multi-index tables: bucket start per key
+    gint *entries[INDEX_CHUNKS];        // Positions sorted by key
+    guint *seen;                // index_query's marks: seen_stamp if found by this query
+    guint seen_stamp;           // Queries run on one thread at a time
+    gint *group;                // First image of the duplicate group, -1 if unhashed
+    gint *group_size;           // Images in the group, set on its first image
+    guint duplicate_groups;
+    gint64 hash_time;
+    gint64 build_time;
+    gint done;                  // Files hashed or found in the cache, atomic
+    gint cancelled;             // Set when the folder is closed, atomic
+    gboolean ready;             // Main thread only
+} PhotoIndex;
+
+// A near-duplicate found by index_query
+typedef struct {
+    gint position;
+    guint distance;
+} IndexMatch;
+
+// Define the application structure
+struct _VynPhotosApp {
     GtkWidget *image;
     GtkWidget *status_bar;
     GtkWidget *window;
@@ -13,9 +62,33 @@ typedef struct {
     gdouble zoom_level;
     gboolean fit_to_window;
     GdkPixbuf *original_pixbuf; // Store original pixbuf for zoom operations
-} VynPhotosApp;
+    PhotoIndex *index;          // Hashes of image_list, NULL until a folder is opened
+    guint index_timeout;        // Updates the indexing progress
+    gboolean collapse_duplicates;   // Navigation skips all but the first of each group
+};
+
+// An image shown in the compare view, copied out of the index since
+// opening another folder replaces it while the view is still open
+typedef struct {
+    gchar *path;
+    gint64 size;
+    guint distance;
+} CompareItem;
+
+// Side-by-side view of an image and its near-duplicates
+typedef struct {
+    VynPhotosApp *app;
+    GtkWidget *window;
+    GtkWidget *images[2];
+    GtkWidget *labels[2];
+    CompareItem original;       // Image being compared
+    GArray *matches;            // CompareItem, nearest first
+    guint current;              // Match shown on the right
+} CompareView;
 
 // Function prototypes
+static GList *list_images(const gchar *dir_path);
+static GdkPixbuf *scale_image(GdkPixbuf *pixbuf, gboolean fit, int width, int height, gdouble zoom);
 static void update_image(VynPhotosApp *app, const gchar *path);
 static void update_status(VynPhotosApp *app);
 static void open_image(GtkWidget *widget, gpointer data);
@@ -24,6 +97,55 @@ static void zoom_out(GtkWidget *widget, gpointer data);
 static void fit_to_window(GtkWidget *widget, gpointer data);
 static void navigate_image(GtkWidget *widget, gpointer data);
 static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer data);
+static int run_bench(const gchar *dir_path, gint passes);
+static void index_start(VynPhotosApp *app, const gchar *dir_path);
+static void index_stop(VynPhotosApp *app);
+static gint index_position(PhotoIndex *index, const gchar *path);
+static void index_query(PhotoIndex *index, gint position, GArray *matches);
+static void step_image(VynPhotosApp *app, gint direction);
+static void show_compare(VynPhotosApp *app);
+static int run_find_duplicates(const gchar *dir_path);
+
+// Function to list the images in a directory, sorted by path
+static GList *list_images(const gchar *dir_path) {
+    GList *list = NULL;
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    if (!dir) return NULL;
+    
+    const gchar *entry;
+    while ((entry = g_dir_read_name(dir))) {
+        gchar *full_path = g_build_filename(dir_path, entry, NULL);
+        if (gdk_pixbuf_get_file_info(full_path, NULL, NULL)) {
+            list = g_list_prepend(list, full_path);
+        } else {
+            g_free(full_path);
+        }
+    }
+    g_dir_close(dir);
+    
+    return g_list_sort(list, (GCompareFunc)g_strcmp0);
+}
+
+// Function to scale an image to fit width x height, or by the zoom level
+static GdkPixbuf *scale_image(GdkPixbuf *pixbuf, gboolean fit, int width, int height, gdouble zoom) {
+    int orig_width = gdk_pixbuf_get_width(pixbuf);
+    int orig_height = gdk_pixbuf_get_height(pixbuf);
+    double scale = zoom;
+    
+    if (fit) {
+        double scale_x = (double)width / orig_width;
+        double scale_y = (double)height / orig_height;
+        scale = MIN(scale_x, scale_y);
+    }
+    
+    int new_width = (int)(orig_width * scale);
+    int new_height = (int)(orig_height * scale);
+    
+    if (new_width > 0 && new_height > 0) {
+        return gdk_pixbuf_scale_simple(pixbuf, new_width, new_height, GDK_INTERP_BILINEAR);
+    }
+    return g_object_ref(pixbuf);
+}
 
 // Function to update the displayed image
 static void update_image(VynPhotosApp *app, const gchar *path) {
@@ -55,51 +177,17 @@ static void update_image(VynPhotosApp *app, const gchar *path) {
     
     if (!app->original_pixbuf) return;
     
-    GdkPixbuf *display_pixbuf = NULL;
+    GdkPixbuf *display_pixbuf;
     
     if (app->fit_to_window) {
         GtkAllocation allocation;
         gtk_widget_get_allocation(GTK_WIDGET(app->window), &allocation);
         
-        // Get original dimensions
-        int orig_width = gdk_pixbuf_get_width(app->original_pixbuf);
-        int orig_height = gdk_pixbuf_get_height(app->original_pixbuf);
-        
-        // Calculate scale to fit window (accounting for some padding)
-        int window_width = allocation.width - 20;
-        int window_height = allocation.height - 100; // Account for toolbar and statusbar
-        
-        double scale_x = (double)window_width / orig_width;
-        double scale_y = (double)window_height / orig_height;
-        double scale = MIN(scale_x, scale_y);
-        
-        int new_width = (int)(orig_width * scale);
-        int new_height = (int)(orig_height * scale);
-        
-        if (new_width > 0 && new_height > 0) {
-            display_pixbuf = gdk_pixbuf_scale_simple(app->original_pixbuf,
-                                                   new_width,
-                                                   new_height,
-                                                   GDK_INTERP_BILINEAR);
-        } else {
-            display_pixbuf = g_object_ref(app->original_pixbuf);
-        }
+        // Fit the window, accounting for padding, toolbar and statusbar
+        display_pixbuf = scale_image(app->original_pixbuf, TRUE,
+                                     allocation.width - 20, allocation.height - 100, 1.0);
     } else {
-        // Apply zoom level
-        int orig_width = gdk_pixbuf_get_width(app->original_pixbuf);
-        int orig_height = gdk_pixbuf_get_height(app->original_pixbuf);
-        
-        int new_width = (int)(orig_width * app->zoom_level);
-        int new_height = (int)(orig_height * app->zoom_level);
-        
-        if (new_width > 0 && new_height > 0) {
-            display_pixbuf = gdk_pixbuf_scale_simple(app->original_pixbuf,
-                                                   new_width,
-                                                   new_height,
-                                                   GDK_INTERP_BILINEAR);
-        } else {
-            display_pixbuf = g_object_ref(app->original_pixbuf);
-        }
+        display_pixbuf = scale_image(app->original_pixbuf, FALSE, 0, 0, app->zoom_level);
     }
     
     if (display_pixbuf) {
@@ -114,12 +202,35 @@ static void update_image(VynPhotosApp *app, const gchar *path) {
 static void update_status(VynPhotosApp *app) {
     if (app->current_image && app->current_image->data) {
         gchar *basename = g_path_get_basename((gchar *)app->current_image->data);
-        gchar *status = g_strdup_printf("%s - Zoom: %.0f%%", 
+        gchar *similar = NULL;
+        
+        // Indexing progress, or how many near-duplicates this image has
+        if (app->index && !app->index->ready) {
+            similar = g_strdup_printf(" - Indexing %d/%u", g_atomic_int_get(&app->index->done),
+                                      app->index->paths->len);
+        } else if (app->index) {
+            gint position = index_position(app->index, (gchar *)app->current_image->data);
+            GArray *matches = g_array_new(FALSE, FALSE, sizeof(IndexMatch));
+            if (position >= 0) {
+                index_query(app->index, position, matches);
+            }
+            if (matches->len > 1) {
+                similar = g_strdup_printf(" - %u similar (C to compare)%s", matches->len - 1,
+                                          app->collapse_duplicates ? ", duplicates collapsed" : "");
+            } else if (app->collapse_duplicates) {
+                similar = g_strdup(" - Duplicates collapsed");
+            }
+            g_array_free(matches, TRUE);
+        }
+        
+        gchar *status = g_strdup_printf("%s - Zoom: %.0f%%%s", 
                                         basename,
-                                        app->zoom_level * 100);
+                                        app->zoom_level * 100,
+                                        similar ? similar : "");
         gtk_statusbar_pop(GTK_STATUSBAR(app->status_bar), 0);
         gtk_statusbar_push(GTK_STATUSBAR(app->status_bar), 0, status);
         g_free(basename);
+        g_free(similar);
         g_free(status);
     }
 }
@@ -137,6 +248,7 @@ static void open_image(GtkWidget *widget, gpointer data) {
                                                     NULL);
     
     // Clean up existing image list
+    index_stop(app);
     if (app->image_list) {
         g_list_free_full(app->image_list, g_free);
         app->image_list = NULL;
@@ -147,34 +259,18 @@ static void open_image(GtkWidget *widget, gpointer data) {
         gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
         if (filename) {
             gchar *dir_path = g_path_get_dirname(filename);
-            GDir *dir = g_dir_open(dir_path, 0, NULL);
-            if (dir) {
-                const gchar *entry;
-                
-                // Build image list
-                while ((entry = g_dir_read_name(dir))) {
-                    gchar *full_path = g_build_filename(dir_path, entry, NULL);
-                    if (gdk_pixbuf_get_file_info(full_path, NULL, NULL)) {
-                        app->image_list = g_list_append(app->image_list, full_path);
-                    } else {
-                        g_free(full_path);
-                    }
-                }
-                g_dir_close(dir);
-                
-                // Sort the image list
-                app->image_list = g_list_sort(app->image_list, (GCompareFunc)g_strcmp0);
-                
-                // Find current image in list
-                app->current_image = g_list_find_custom(app->image_list, filename, (GCompareFunc)g_strcmp0);
-                if (!app->current_image && app->image_list) {
-                    app->current_image = app->image_list;
-                }
-                
-                if (app->current_image) {
-                    app->zoom_level = 1.0; // Reset zoom level
-                    update_image(app, (gchar *)app->current_image->data);
-                }
+            app->image_list = list_images(dir_path);
+            index_start(app, dir_path);
+            
+            // Find current image in list
+            app->current_image = g_list_find_custom(app->image_list, filename, (GCompareFunc)g_strcmp0);
+            if (!app->current_image && app->image_list) {
+                app->current_image = app->image_list;
+            }
+            
+            if (app->current_image) {
+                app->zoom_level = 1.0; // Reset zoom level
+                update_image(app, (gchar *)app->current_image->data);
             }
             g_free(dir_path);
             g_free(filename);
@@ -221,32 +317,36 @@ static void fit_to_window(GtkWidget *widget, gpointer data) {
     }
 }
 
-// Function to navigate through images
-static void navigate_image(GtkWidget *widget, gpointer data) {
-    VynPhotosApp *app = data;
-    gint direction = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "direction"));
-    
+// Function to step to the next or previous image, wrapping around. With
+// duplicates collapsed, only the first image of each group is shown.
+static void step_image(VynPhotosApp *app, gint direction) {
     if (!app->image_list || !app->current_image) return;
     
-    if (direction > 0) {
-        GList *next = g_list_next(app->current_image);
-        if (next) {
-            app->current_image = next;
+    PhotoIndex *index = app->collapse_duplicates && app->index && app->index->ready ? app->index : NULL;
+    GList *link = app->current_image;
+    do {
+        if (direction > 0) {
+            link = link->next ? link->next : app->image_list; // Wrap around to first image
         } else {
-            app->current_image = app->image_list; // Wrap around to first image
+            link = link->prev ? link->prev : g_list_last(app->image_list); // Wrap around to last image
         }
-    } else {
-        GList *prev = g_list_previous(app->current_image);
-        if (prev) {
-            app->current_image = prev;
-        } else {
-            app->current_image = g_list_last(app->image_list); // Wrap around to last image
+        
+        gint position = index ? index_position(index, (gchar *)link->data) : -1;
+        if (position < 0 || index->group[position] < 0 || index->group[position] == position) {
+            break;
         }
-    }
+    } while (link != app->current_image);
     
-    if (app->current_image && app->current_image->data) {
-        update_image(app, (gchar *)app->current_image->data);
-    }
+    app->current_image = link;
+    update_image(app, (gchar *)app->current_image->data);
+}
+
+// Function to navigate through images
+static void navigate_image(GtkWidget *widget, gpointer data) {
+    VynPhotosApp *app = data;
+    gint direction = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "direction"));
+    
+    step_image(app, direction);
 }
 
 // Function to handle key press events
@@ -256,27 +356,19 @@ static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer
     switch (event->keyval) {
         case GDK_KEY_Left:
         case GDK_KEY_KP_Left:
-            if (app->image_list && app->current_image) {
-                GList *prev = g_list_previous(app->current_image);
-                if (prev) {
-                    app->current_image = prev;
-                } else {
-                    app->current_image = g_list_last(app->image_list);
-                }
-                update_image(app, (gchar *)app->current_image->data);
-            }
+            step_image(app, -1);
             return TRUE;
         case GDK_KEY_Right:
         case GDK_KEY_KP_Right:
-            if (app->image_list && app->current_image) {
-                GList *next = g_list_next(app->current_image);
-                if (next) {
-                    app->current_image = next;
-                } else {
-                    app->current_image = app->image_list;
-                }
-                update_image(app, (gchar *)app->current_image->data);
-            }
+            step_image(app, 1);
+            return TRUE;
+        case GDK_KEY_d:
+            // Toggle collapsing near-duplicates while navigating
+            app->collapse_duplicates = !app->collapse_duplicates;
+            update_status(app);
+            return TRUE;
+        case GDK_KEY_c:
+            show_compare(app);
             return TRUE;
         case GDK_KEY_q:
             if (event->state & GDK_CONTROL_MASK) {
@@ -300,12 +392,727 @@ static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer
     }
 }
 
+// Hash kernel tables, filled once: the 8 lowest DCT frequencies at each of
+// the HASH_SIZE sample points, and every 16-bit mask of at most
+// INDEX_CHUNK_RADIUS bits
+static v8f dct_basis[HASH_SIZE];
+static guint16 *chunk_masks;
+static guint n_chunk_masks;
+
+static gpointer init_hash_tables(gpointer data) {
+    (void)data;
+    for (int x = 0; x < HASH_SIZE; x++) {
+        for (int u = 0; u < 8; u++) {
+            dct_basis[x][u] = cosf((2 * x + 1) * u * (float)G_PI / (2 * HASH_SIZE));
+        }
+    }
+    chunk_masks = g_new(guint16, 65536);
+    for (guint mask = 0; mask < 65536; mask++) {
+        if (__builtin_popcount(mask) <= INDEX_CHUNK_RADIUS) {
+            chunk_masks[n_chunk_masks++] = mask;
+        }
+    }
+    return NULL;
+}
+
+static GOnce hash_tables_once = G_ONCE_INIT;
+
+static inline guint hamming(guint64 a, guint64 b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Function to compute the pHash: one bit per low DCT frequency, set when
+// it is above the median. Rows are transformed first, all eight
+// frequencies at once, then the columns of the result.
+static guint64 compute_phash(float gray[HASH_SIZE][HASH_SIZE]) {
+    v8f rows[HASH_SIZE];
+    float coeffs[64], sorted[63];
+    
+    for (int y = 0; y < HASH_SIZE; y++) {
+        v8f acc = {0};
+        for (int x = 0; x < HASH_SIZE; x++) {
+            acc += gray[y][x] * dct_basis[x];
+        }
+        rows[y] = acc;
+    }
+    for (int v = 0; v < 8; v++) {
+        v8f acc = {0};
+        for (int y = 0; y < HASH_SIZE; y++) {
+            acc += dct_basis[y][v] * rows[y];
+        }
+        for (int u = 0; u < 8; u++) {
+            coeffs[v * 8 + u] = acc[u];
+        }
+    }
+    
+    // The DC term only carries the overall brightness
+    memcpy(sorted, coeffs + 1, sizeof(sorted));
+    qsort(sorted, 63, sizeof(float), compare_floats);
+    guint64 hash = 0;
+    for (int i = 1; i < 64; i++) {
+        if (coeffs[i] > sorted[31]) {
+            hash |= G_GUINT64_CONSTANT(1) << i;
+        }
+    }
+    return hash;
+}
+
+// Function to compute the dHash: on a 9x8 grid of cell averages, one bit
+// per cell brighter than its right neighbour
+static guint64 compute_dhash(float gray[HASH_SIZE][HASH_SIZE]) {
+    guint64 hash = 0;
+    for (int row = 0; row < 8; row++) {
+        float cells[9];
+        for (int col = 0; col < 9; col++) {
+            int x0 = col * HASH_SIZE / 9;
+            int x1 = (col + 1) * HASH_SIZE / 9;
+            float sum = 0;
+            for (int y = row * HASH_SIZE / 8; y < (row + 1) * HASH_SIZE / 8; y++) {
+                for (int x = x0; x < x1; x++) {
+                    sum += gray[y][x];
+                }
+            }
+            cells[col] = sum / ((x1 - x0) * HASH_SIZE / 8);
+        }
+        for (int col = 0; col < 8; col++) {
+            if (cells[col] > cells[col + 1]) {
+                hash |= G_GUINT64_CONSTANT(1) << (row * 8 + col);
+            }
+        }
+    }
+    return hash;
+}
+
+// Function to hash an image. Loaders that can scale while decoding (JPEG
+// among them) only decode a fraction of the pixels at this size.
+static gboolean hash_image(const gchar *path, guint64 *phash, guint64 *dhash) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_scale(path, HASH_SIZE, HASH_SIZE, FALSE, NULL);
+    if (!pixbuf) return FALSE;
+    
+    if (gdk_pixbuf_get_width(pixbuf) != HASH_SIZE || gdk_pixbuf_get_height(pixbuf) != HASH_SIZE) {
+        GdkPixbuf *scaled = gdk_pixbuf_scale_simple(pixbuf, HASH_SIZE, HASH_SIZE, GDK_INTERP_BILINEAR);
+        g_object_unref(pixbuf);
+        pixbuf = scaled;
+    }
+    
+    float gray[HASH_SIZE][HASH_SIZE];
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    int stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8 *pixels = gdk_pixbuf_read_pixels(pixbuf);
+    for (int y = 0; y < HASH_SIZE; y++) {
+        for (int x = 0; x < HASH_SIZE; x++) {
+            const guint8 *p = pixels + y * stride + x * channels;
+            gray[y][x] = 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2];
+        }
+    }
+    g_object_unref(pixbuf);
+    
+    *phash = compute_phash(gray);
+    *dhash = compute_dhash(gray);
+    return TRUE;
+}
+
+// Function to get the index position of an image, -1 if it is not indexed
+static gint index_position(PhotoIndex *index, const gchar *path) {
+    return GPOINTER_TO_INT(g_hash_table_lookup(index->positions, path)) - 1;
+}
+
+static PhotoIndex *index_new(const gchar *dir_path, GList *images) {
+    PhotoIndex *index = g_new0(PhotoIndex, 1);
+    index->dir_path = g_strdup(dir_path);
+    index->paths = g_ptr_array_new_with_free_func(g_free);
+    index->positions = g_hash_table_new(g_str_hash, g_str_equal);
+    for (GList *l = images; l; l = l->next) {
+        g_ptr_array_add(index->paths, g_strdup((gchar *)l->data));
+        g_hash_table_insert(index->positions, g_ptr_array_index(index->paths, index->paths->len - 1),
+                            GINT_TO_POINTER(index->paths->len));
+    }
+    
+    guint n = index->paths->len;
+    index->phash = g_new0(guint64, n);
+    index->dhash = g_new0(guint64, n);
+    index->mtime = g_new0(gint64, n);
+    index->size = g_new0(gint64, n);
+    index->hashed = g_new0(gboolean, n);
+    return index;
+}
+
+static void index_free(PhotoIndex *index) {
+    g_free(index->seen);
+    for (int t = 0; t < INDEX_CHUNKS; t++) {
+        g_free(index->offsets[t]);
+        g_free(index->entries[t]);
+    }
+    g_free(index->group);
+    g_free(index->group_size);
+    g_free(index->hashed);
+    g_free(index->size);
+    g_free(index->mtime);
+    g_free(index->dhash);
+    g_free(index->phash);
+    g_hash_table_destroy(index->positions);
+    g_ptr_array_free(index->paths, TRUE);
+    g_free(index->dir_path);
+    g_free(index);
+}
+
+// Hashes are cached per folder, one line per file:
+// mtime size phash dhash name
+typedef struct {
+    gint64 mtime;
+    gint64 size;
+    guint64 phash;
+    guint64 dhash;
+} CacheEntry;
+
+static gchar *index_cache_path(const gchar *dir_path) {
+    gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, dir_path, -1);
+    gchar *name = g_strdup_printf("%s.txt", hash);
+    gchar *path = g_build_filename(g_get_user_cache_dir(), "vyn-photos", "hashes", name, NULL);
+    g_free(name);
+    g_free(hash);
+    return path;
+}
+
+// Function to load a folder's cached hashes, keyed by file name
+static GHashTable *index_load_cache(const gchar *dir_path) {
+    GHashTable *cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    gchar *path = index_cache_path(dir_path);
+    gchar *contents = NULL;
+    
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        for (gchar **line = lines; *line; line++) {
+            CacheEntry entry;
+            int name_start = 0;
+            if (sscanf(*line, "%" G_GINT64_MODIFIER "d %" G_GINT64_MODIFIER "d %" G_GINT64_MODIFIER "x %"
+                       G_GINT64_MODIFIER "x %n", &entry.mtime, &entry.size, &entry.phash, &entry.dhash,
+                       &name_start) == 4 && name_start > 0 && (*line)[name_start]) {
+                g_hash_table_insert(cache, g_strdup(*line + name_start), g_memdup2(&entry, sizeof(entry)));
+            }
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+    g_free(path);
+    return cache;
+}
+
+static void index_save_cache(PhotoIndex *index) {
+    GString *contents = g_string_new(NULL);
+    for (guint i = 0; i < index->paths->len; i++) {
+        if (!index->hashed[i]) continue;
+        gchar *name = g_path_get_basename(g_ptr_array_index(index->paths, i));
+        g_string_append_printf(contents, "%" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %016" G_GINT64_MODIFIER "x %016"
+                               G_GINT64_MODIFIER "x %s\n", index->mtime[i], index->size[i],
+                               index->phash[i], index->dhash[i], name);
+        g_free(name);
+    }
+    
+    gchar *path = index_cache_path(index->dir_path);
+    gchar *dir = g_path_get_dirname(path);
+    GError *error = NULL;
+    if (g_mkdir_with_parents(dir, 0700) != 0 ||
+        !g_file_set_contents(path, contents->str, contents->len, &error)) {
+        g_printerr("Failed to save image hashes: %s\n", error ? error->message : dir);
+        g_clear_error(&error);
+    }
+    g_free(dir);
+    g_free(path);
+    g_string_free(contents, TRUE);
+}
+
+// Thread pool worker: hash one image
+static void index_hash_task(gpointer data, gpointer user_data) {
+    PhotoIndex *index = user_data;
+    gint i = GPOINTER_TO_INT(data) - 1;
+    
+    if (!g_atomic_int_get(&index->cancelled)) {
+        index->hashed[i] = hash_image(g_ptr_array_index(index->paths, i), &index->phash[i], &index->dhash[i]);
+    }
+    g_atomic_int_inc(&index->done);
+}
+
+static inline guint index_chunk(guint64 hash, int t) {
+    return (hash >> (16 * t)) & 0xffff;
+}
+
+// Function to build the multi-index tables: for each 16-bit chunk of the
+// pHash, the images sorted by that chunk, with the start of every bucket
+static void index_build_tables(PhotoIndex *index) {
+    guint n = index->paths->len;
+    for (int t = 0; t < INDEX_CHUNKS; t++) {
+        guint32 *offsets = g_new0(guint32, 65537);
+        guint32 *fill = g_new(guint32, 65536);
+        gint *entries = g_new(gint, n);
+        
+        for (guint i = 0; i < n; i++) {
+            if (index->hashed[i]) offsets[index_chunk(index->phash[i], t) + 1]++;
+        }
+        for (guint key = 0; key < 65536; key++) {
+            offsets[key + 1] += offsets[key];
+        }
+        memcpy(fill, offsets, 65536 * sizeof(guint32));
+        for (guint i = 0; i < n; i++) {
+            if (index->hashed[i]) entries[fill[index_chunk(index->phash[i], t)]++] = i;
+        }
+        
+        g_free(fill);
+        index->offsets[t] = offsets;
+        index->entries[t] = entries;
+    }
+    index->seen = g_new0(guint, n);
+}
+
+static gint compare_matches(gconstpointer a, gconstpointer b) {
+    const IndexMatch *x = a;
+    const IndexMatch *y = b;
+    if (x->distance != y->distance) return x->distance < y->distance ? -1 : 1;
+    return x->position - y->position;
+}
+
+// Function to find the near-duplicates of an image, itself included,
+// nearest first. Two hashes within DUPLICATE_PHASH_DISTANCE bits agree to
+// within INDEX_CHUNK_RADIUS bits on at least one of the INDEX_CHUNKS
+// chunks, so only the buckets that close to the image's own are probed.
+static void index_query(PhotoIndex *index, gint position, GArray *matches) {
+    if (!index->hashed[position]) return;
+    guint64 phash = index->phash[position];
+    guint64 dhash = index->dhash[position];
+    
+    // Close matches can share several chunks; a fresh stamp marks the ones
+    // this query has kept, without clearing the marks of the last one
+    if (++index->seen_stamp == 0) {
+        memset(index->seen, 0, index->paths->len * sizeof(guint));
+        index->seen_stamp = 1;
+    }
+    
+    for (int t = 0; t < INDEX_CHUNKS; t++) {
+        guint key = index_chunk(phash, t);
+        for (guint m = 0; m < n_chunk_masks; m++) {
+            guint bucket = key ^ chunk_masks[m];
+            for (guint32 e = index->offsets[t][bucket]; e < index->offsets[t][bucket + 1]; e++) {
+                gint candidate = index->entries[t][e];
+                if (index->seen[candidate] == index->seen_stamp) continue;
+                guint distance = hamming(phash, index->phash[candidate]);
+                if (distance > DUPLICATE_PHASH_DISTANCE ||
+                    hamming(dhash, index->dhash[candidate]) > DUPLICATE_DHASH_DISTANCE) continue;
+                
+                IndexMatch match = { candidate, distance };
+                index->seen[candidate] = index->seen_stamp;
+                g_array_append_val(matches, match);
+            }
+        }
+    }
+    g_array_sort(matches, compare_matches);
+}
+
+// Function to group near-duplicates: each image not yet in a group starts
+// one and takes in its ungrouped matches, so the first image of a burst in
+// name order represents it
+static void index_group(PhotoIndex *index) {
+    guint n = index->paths->len;
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(IndexMatch));
+    index->group = g_new(gint, n);
+    index->group_size = g_new0(gint, n);
+    for (guint i = 0; i < n; i++) {
+        index->group[i] = -1;
+    }
+    
+    for (guint i = 0; i < n; i++) {
+        if (!index->hashed[i] || index->group[i] >= 0) continue;
+        g_array_set_size(matches, 0);
+        index_query(index, i, matches);
+        index->group[i] = i;
+        index->group_size[i] = 1;
+        for (guint k = 0; k < matches->len; k++) {
+            gint position = g_array_index(matches, IndexMatch, k).position;
+            if (index->group[position] < 0) {
+                index->group[position] = i;
+                index->group_size[i]++;
+            }
+        }
+        if (index->group_size[i] > 1) index->duplicate_groups++;
+    }
+    g_array_free(matches, TRUE);
+}
+
+// Function to build the index: hashes come from the cache when the file's
+// mtime and size match, the rest are computed on a pool of one thread per
+// core
+static void index_build(PhotoIndex *index) {
+    guint n = index->paths->len;
+    gint64 start = g_get_monotonic_time();
+    GHashTable *cache = index_load_cache(index->dir_path);
+    GThreadPool *pool = g_thread_pool_new(index_hash_task, index, g_get_num_processors(), TRUE, NULL);
+    
+    g_once(&hash_tables_once, init_hash_tables, NULL);
+    for (guint i = 0; i < n && !g_atomic_int_get(&index->cancelled); i++) {
+        const gchar *path = g_ptr_array_index(index->paths, i);
+        gchar *name = g_path_get_basename(path);
+        CacheEntry *entry = g_hash_table_lookup(cache, name);
+        GStatBuf st;
+        
+        if (g_stat(path, &st) == 0) {
+            index->mtime[i] = st.st_mtime;
+            index->size[i] = st.st_size;
+        }
+        if (entry && entry->mtime == index->mtime[i] && entry->size == index->size[i]) {
+            index->phash[i] = entry->phash;
+            index->dhash[i] = entry->dhash;
+            index->hashed[i] = TRUE;
+            index->cached++;
+            g_atomic_int_inc(&index->done);
+        } else {
+            g_thread_pool_push(pool, GINT_TO_POINTER(i + 1), NULL);
+        }
+        g_free(name);
+    }
+    // Rewrite the cache if files were added, changed or removed
+    index->cache_dirty = index->cached != n || g_hash_table_size(cache) != n;
+    g_hash_table_destroy(cache);
+    g_thread_pool_free(pool, FALSE, TRUE);
+    index->hash_time = g_get_monotonic_time() - start;
+    if (g_atomic_int_get(&index->cancelled)) return;
+    
+    start = g_get_monotonic_time();
+    index_build_tables(index);
+    index_group(index);
+    index->build_time = g_get_monotonic_time() - start;
+    
+    if (index->cache_dirty) {
+        index_save_cache(index);
+    }
+}
+
+// Function to show the finished index, or free it if the folder was closed
+static gboolean index_ready(gpointer data) {
+    PhotoIndex *index = data;
+    
+    if (g_atomic_int_get(&index->cancelled)) {
+        index_free(index);
+        return G_SOURCE_REMOVE;
+    }
+    index->ready = TRUE;
+    update_status(index->app);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer index_thread(gpointer data) {
+    index_build(data);
+    g_idle_add(index_ready, data);
+    return NULL;
+}
+
+// Function to update the indexing progress in the status bar
+static gboolean index_progress(gpointer data) {
+    VynPhotosApp *app = data;
+    
+    if (!app->index || app->index->ready) {
+        app->index_timeout = 0;
+        return G_SOURCE_REMOVE;
+    }
+    update_status(app);
+    return G_SOURCE_CONTINUE;
+}
+
+// Function to start indexing the images of a folder in the background
+static void index_start(VynPhotosApp *app, const gchar *dir_path) {
+    index_stop(app);
+    if (!app->image_list) return;
+    
+    app->index = index_new(dir_path, app->image_list);
+    app->index->app = app;
+    g_thread_unref(g_thread_new("vyn-photos-index", index_thread, app->index));
+    if (!app->index_timeout) {
+        app->index_timeout = g_timeout_add(250, index_progress, app);
+    }
+}
+
+// Function to drop the index. One still building is cancelled and freed
+// once its thread finishes.
+static void index_stop(VynPhotosApp *app) {
+    if (!app->index) return;
+    
+    if (app->index->ready) {
+        index_free(app->index);
+    } else {
+        g_atomic_int_set(&app->index->cancelled, TRUE);
+    }
+    app->index = NULL;
+}
+
+// Function to show one side of the compare view
+static void compare_show_image(CompareView *view, int side, const CompareItem *item, gboolean is_match) {
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file(item->path, NULL);
+    gchar *basename = g_path_get_basename(item->path);
+    gchar *size = g_format_size(item->size);
+    gchar *details;
+    
+    if (pixbuf) {
+        GdkPixbuf *scaled = scale_image(pixbuf, TRUE, 480, 480, 1.0);
+        gtk_image_set_from_pixbuf(GTK_IMAGE(view->images[side]), scaled);
+        details = g_strdup_printf("%s\n%d x %d, %s", basename, gdk_pixbuf_get_width(pixbuf),
+                                  gdk_pixbuf_get_height(pixbuf), size);
+        g_object_unref(scaled);
+        g_object_unref(pixbuf);
+    } else {
+        gtk_image_clear(GTK_IMAGE(view->images[side]));
+        details = g_strdup_printf("%s\n%s", basename, size);
+    }
+    
+    if (is_match) {
+        gchar *label = g_strdup_printf("%s\n%u bits apart - match %u of %u", details, item->distance,
+                                       view->current + 1, view->matches->len);
+        gtk_label_set_text(GTK_LABEL(view->labels[side]), label);
+        g_free(label);
+    } else {
+        gtk_label_set_text(GTK_LABEL(view->labels[side]), details);
+    }
+    g_free(details);
+    g_free(size);
+    g_free(basename);
+}
+
+static void compare_update(CompareView *view) {
+    compare_show_image(view, 1, &g_array_index(view->matches, CompareItem, view->current), TRUE);
+}
+
+static gboolean compare_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    CompareView *view = data;
+    CompareItem *match;
+    GList *link;
+    (void)widget;
+    
+    switch (event->keyval) {
+        case GDK_KEY_Left:
+        case GDK_KEY_KP_Left:
+            view->current = (view->current + view->matches->len - 1) % view->matches->len;
+            compare_update(view);
+            return TRUE;
+        case GDK_KEY_Right:
+        case GDK_KEY_KP_Right:
+            view->current = (view->current + 1) % view->matches->len;
+            compare_update(view);
+            return TRUE;
+        case GDK_KEY_Return:
+        case GDK_KEY_KP_Enter:
+            // Show the match in the main window, if it still shows its folder
+            match = &g_array_index(view->matches, CompareItem, view->current);
+            link = g_list_find_custom(view->app->image_list, match->path, (GCompareFunc)g_strcmp0);
+            if (link) {
+                view->app->current_image = link;
+                update_image(view->app, (gchar *)link->data);
+            }
+            gtk_widget_destroy(view->window);
+            return TRUE;
+        case GDK_KEY_Escape:
+            gtk_widget_destroy(view->window);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+static void compare_destroy(GtkWidget *widget, gpointer data) {
+    CompareView *view = data;
+    (void)widget;
+    g_free(view->original.path);
+    for (guint k = 0; k < view->matches->len; k++) {
+        g_free(g_array_index(view->matches, CompareItem, k).path);
+    }
+    g_array_free(view->matches, TRUE);
+    g_free(view);
+}
+
+// Function to compare the current image side by side with its
+// near-duplicates, nearest first
+static void show_compare(VynPhotosApp *app) {
+    if (!app->index || !app->index->ready || !app->current_image) return;
+    
+    gint position = index_position(app->index, (gchar *)app->current_image->data);
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(IndexMatch));
+    if (position >= 0) {
+        index_query(app->index, position, matches);
+    }
+    // A hashed image always matches itself
+    if (matches->len < 2) {
+        gtk_statusbar_pop(GTK_STATUSBAR(app->status_bar), 0);
+        gtk_statusbar_push(GTK_STATUSBAR(app->status_bar), 0, "No similar images");
+        g_array_free(matches, TRUE);
+        return;
+    }
+    
+    CompareView *view = g_new0(CompareView, 1);
+    view->app = app;
+    view->original.path = g_strdup(g_ptr_array_index(app->index->paths, position));
+    view->original.size = app->index->size[position];
+    view->matches = g_array_sized_new(FALSE, FALSE, sizeof(CompareItem), matches->len - 1);
+    for (guint k = 0; k < matches->len; k++) {
+        IndexMatch *match = &g_array_index(matches, IndexMatch, k);
+        if (match->position == position) continue;
+        CompareItem item = {
+            g_strdup(g_ptr_array_index(app->index->paths, match->position)),
+            app->index->size[match->position],
+            match->distance
+        };
+        g_array_append_val(view->matches, item);
+    }
+    g_array_free(matches, TRUE);
+    view->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(view->window), "Compare - Left/Right: next match, Enter: open, Esc: close");
+    gtk_window_set_transient_for(GTK_WINDOW(view->window), GTK_WINDOW(app->window));
+    gtk_window_set_default_size(GTK_WINDOW(view->window), 1000, 580);
+    g_signal_connect(view->window, "key-press-event", G_CALLBACK(compare_key_press), view);
+    g_signal_connect(view->window, "destroy", G_CALLBACK(compare_destroy), view);
+    
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+    gtk_box_set_homogeneous(GTK_BOX(box), TRUE);
+    gtk_container_add(GTK_CONTAINER(view->window), box);
+    for (int side = 0; side < 2; side++) {
+        GtkWidget *column = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+        view->images[side] = gtk_image_new();
+        view->labels[side] = gtk_label_new(NULL);
+        gtk_label_set_justify(GTK_LABEL(view->labels[side]), GTK_JUSTIFY_CENTER);
+        gtk_box_pack_start(GTK_BOX(column), view->images[side], TRUE, TRUE, 0);
+        gtk_box_pack_start(GTK_BOX(column), view->labels[side], FALSE, FALSE, 5);
+        gtk_box_pack_start(GTK_BOX(box), column, TRUE, TRUE, 0);
+    }
+    
+    compare_show_image(view, 0, &view->original, FALSE);
+    compare_update(view);
+    gtk_widget_show_all(view->window);
+}
+
+// Function to print the near-duplicate groups of a folder without opening
+// a window
+static int run_find_duplicates(const gchar *dir_path) {
+    GList *images = list_images(dir_path);
+    if (!images) {
+        g_printerr("No images found in %s\n", dir_path);
+        return 1;
+    }
+    
+    PhotoIndex *index = index_new(dir_path, images);
+    g_list_free_full(images, g_free);
+    index_build(index);
+    
+    guint n = index->paths->len;
+    for (guint i = 0; i < n; i++) {
+        if (index->group[i] != (gint)i || index->group_size[i] < 2) continue;
+        g_print("%s\n", (gchar *)g_ptr_array_index(index->paths, i));
+        for (guint j = i + 1; j < n; j++) {
+            if (index->group[j] == (gint)i) {
+                g_print("  %s (%u bits)\n", (gchar *)g_ptr_array_index(index->paths, j),
+                        hamming(index->phash[i], index->phash[j]));
+            }
+        }
+    }
+    
+    g_print("%u images, %u from cache, hashed in %.2f s\n", n, index->cached,
+            index->hash_time / (gdouble)G_USEC_PER_SEC);
+    g_print("%u duplicate groups; index and grouping %.1f ms, %.3f ms per image\n",
+            index->duplicate_groups, index->build_time / 1000.0, index->build_time / 1000.0 / n);
+    index_free(index);
+    return 0;
+}
+
+// Function to time headless navigation through a folder: every image is
+// loaded, fitted to the default window and zoomed in and out three steps,
+// as the toolbar buttons would
+static int run_bench(const gchar *dir_path, gint passes) {
+    GList *images = list_images(dir_path);
+    if (!images) {
+        g_printerr("No images found in %s\n", dir_path);
+        return 1;
+    }
+    
+    guint loaded = 0, scaled = 0;
+    guint64 pixels = 0;
+    gint64 load_time = 0, scale_time = 0;
+    
+    for (gint pass = 0; pass < passes; pass++) {
+        for (GList *l = images; l; l = l->next) {
+            gint64 start = g_get_monotonic_time();
+            GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file((gchar *)l->data, NULL);
+            load_time += g_get_monotonic_time() - start;
+            if (!pixbuf) continue;
+            loaded++;
+            pixels += (guint64)gdk_pixbuf_get_width(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+            
+            start = g_get_monotonic_time();
+            g_object_unref(scale_image(pixbuf, TRUE, 800 - 20, 600 - 100, 1.0));
+            gdouble zoom = 1.0;
+            for (gint step = 0; step < 3; step++) {
+                zoom *= 1.1;
+                g_object_unref(scale_image(pixbuf, FALSE, 0, 0, zoom));
+            }
+            zoom = 1.0;
+            for (gint step = 0; step < 3; step++) {
+                zoom *= 0.9;
+                g_object_unref(scale_image(pixbuf, FALSE, 0, 0, zoom));
+            }
+            scale_time += g_get_monotonic_time() - start;
+            scaled += 7;
+            g_object_unref(pixbuf);
+        }
+    }
+    
+    g_print("%u images (%.1f megapixels) from %s\n", loaded, pixels / 1e6, dir_path);
+    if (loaded > 0) {
+        g_print("load:  %.2f ms per image, %.1f megapixels/s\n",
+                load_time / 1000.0 / loaded, pixels / (gdouble)load_time);
+        g_print("scale: %.2f ms per fit or zoom step\n", scale_time / 1000.0 / scaled);
+    }
+    g_list_free_full(images, g_free);
+    return loaded > 0 ? 0 : 1;
+}
+
 // Main function
 int main(int argc, char *argv[]) {
     GtkWidget *toolbar;
     GtkWidget *scrolled_window, *box;
     VynPhotosApp app = {0};
     GtkToolItem *open_toolitem, *prev_toolitem, *next_toolitem, *zoom_in_toolitem, *zoom_out_toolitem, *fit_toolitem;
+    static gchar *bench_dir = NULL;
+    static gint bench_passes = 1;
+    static gchar *duplicates_dir = NULL;
+    static GOptionEntry entries[] = {
+        { "bench", 0, 0, G_OPTION_ARG_FILENAME, &bench_dir,
+          "Time loading and scaling every image in DIR without opening a window", "DIR" },
+        { "bench-passes", 0, 0, G_OPTION_ARG_INT, &bench_passes,
+          "Times to go through the folder with --bench (default 1)", "N" },
+        { "find-duplicates", 0, 0, G_OPTION_ARG_FILENAME, &duplicates_dir,
+          "Print the groups of near-duplicate images in DIR and exit", "DIR" },
+        { NULL }
+    };
+    GOptionContext *context;
+    GError *error = NULL;
+
+    // Parse options before connecting to the display so --bench runs headless
+    context = g_option_context_new("- Vyn Photos");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gtk_get_option_group(FALSE));
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if (bench_dir) {
+        return run_bench(bench_dir, MAX(bench_passes, 1));
+    }
+    if (duplicates_dir) {
+        return run_find_duplicates(duplicates_dir);
+    }
 
     gtk_init(&argc, &argv);
 
@@ -3,7 +3,176 @@
 #include <glib.h>
 #include <gst/gst.h>
 #include <gst/video/videooverlay.h>
+#include <gst/video/video.h>
+#include <gst/app/gstappsink.h>
+#include <glib/gstdio.h>
 #include <gdk/gdkx.h>  // For X11 window handle
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <unistd.h>
+
+// Hover preview settings.
+#define PREVIEW_WIDTH 160           // Preview frames are scaled to this width
+#define PREVIEW_CACHE_SIZE 256      // Frames kept in the LRU cache
+#define PREVIEW_SPRITE_COLUMNS 10
+#define PREVIEW_SPRITE_FRAMES 100   // Frames in a pre-generated sprite sheet
+
+// Above this playback rate only keyframes are decoded.
+#define TRICKMODE_RATE 2.0
+
+// Playback rates selectable with [ and ].
+static const gdouble playback_rates[] = { 0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0 };
+
+// Batch mode settings.
+#define BATCH_JOB_MEMORY_MB 256     // Memory budgeted per concurrent pipeline
+#define BATCH_SCENE_FPS 5           // Frames per second compared for scene changes
+#define BATCH_SCENE_GRID_WIDTH 64   // Frames are compared on a grid of sample points
+#define BATCH_SCENE_GRID_HEIGHT 36
+
+typedef enum {
+    BATCH_FRAMES,
+    BATCH_SHEET,
+    BATCH_TRANSCODE
+} BatchMode;
+
+// Transcode targets for --batch=transcode. Each branch is appended to the
+// player's decode chain; both end in the muxer.
+typedef struct {
+    const gchar *name;
+    const gchar *extension;
+    const gchar *video;
+    const gchar *audio;
+    const gchar *muxer;
+} TranscodeProfile;
+
+static const TranscodeProfile transcode_profiles[] = {
+    { "h264-1080p", "mp4",
+      "videoscale ! video/x-raw,height=1080,pixel-aspect-ratio=1/1 ! "
+      "x264enc bitrate=5000 speed-preset=veryfast key-int-max=60 ! h264parse",
+      "audioconvert ! audioresample ! avenc_aac bitrate=160000 ! aacparse", "mp4mux faststart=true" },
+    { "h264-720p", "mp4",
+      "videoscale ! video/x-raw,height=720,pixel-aspect-ratio=1/1 ! "
+      "x264enc bitrate=2500 speed-preset=veryfast key-int-max=60 ! h264parse",
+      "audioconvert ! audioresample ! avenc_aac bitrate=128000 ! aacparse", "mp4mux faststart=true" },
+    { "h264-480p", "mp4",
+      "videoscale ! video/x-raw,height=480,pixel-aspect-ratio=1/1 ! "
+      "x264enc bitrate=1000 speed-preset=veryfast key-int-max=60 ! h264parse",
+      "audioconvert ! audioresample ! avenc_aac bitrate=96000 ! aacparse", "mp4mux faststart=true" },
+    { "vp8-480p", "webm",
+      "videoscale ! video/x-raw,height=480,pixel-aspect-ratio=1/1 ! "
+      "vp8enc deadline=1 target-bitrate=1000000 keyframe-max-dist=60",
+      "audioconvert ! audioresample ! opusenc bitrate=96000", "webmmux" }
+};
+
+// A --batch run. Settings are fixed before the workers start; the counters
+// are guarded by lock.
+typedef struct {
+    BatchMode mode;
+    gchar *output_dir;
+    gdouble interval;           // BATCH_FRAMES: seconds between frames
+    gdouble scene_threshold;    // BATCH_FRAMES: extract on scene changes instead, 0 for off
+    gint sheet_frames;          // BATCH_SHEET
+    gint sheet_columns;
+    gint sheet_width;
+    const TranscodeProfile *profile;    // BATCH_TRANSCODE
+    gboolean force;             // Redo outputs newer than their input
+    guint threads;              // Decoder and encoder threads per pipeline
+    
+    GMutex lock;
+    guint total;
+    guint done;
+    guint skipped;
+    guint failed;
+} BatchConfig;
+
+// One input file of a --batch run.
+typedef struct {
+    gchar *path;
+    gchar *relative;            // Path below the scanned directory, without extension
+    gint64 size;
+} BatchJob;
+
+// Network streaming settings, fixed after startup.
+typedef struct {
+    gchar *cache_dir;           // Directory for on-disk download buffers, NULL to stay in memory
+    gint cache_size_mb;         // Size of the on-disk download ring buffer
+    gint prefetch_seconds;      // How far ahead adaptive streams download segments
+    gint max_bitrate;           // Upper bound for adaptive variant selection, 0 for none
+} StreamConfig;
+
+// Startup trace, enabled with --startup-trace. Times are relative to main().
+static gboolean trace_enabled = FALSE;
+static gint64 trace_start = 0;
+
+// Elements loaded ahead of time so the first open skips plugin loading.
+static const gchar *prewarm_elements[] = {
+    "filesrc", "qtdemux", "queue", "h264parse", "avdec_h264", "videoconvert", "gtksink",
+    "aacparse", "avdec_aac", "audioconvert", "scaletempo", "audioresample", "autoaudiosink"
+};
+
+// Commands handled by the pipeline controller thread.
+typedef enum {
+    PLAYER_CMD_OPEN,
+    PLAYER_CMD_PLAY,
+    PLAYER_CMD_PAUSE,
+    PLAYER_CMD_STOP,
+    PLAYER_CMD_SEEK,
+    PLAYER_CMD_SEEK_RELATIVE,
+    PLAYER_CMD_SET_RATE,
+    PLAYER_CMD_BUS_MESSAGE,
+    PLAYER_CMD_QUIT
+} PlayerCommandType;
+
+typedef struct {
+    PlayerCommandType type;
+    guint serial;         // Open request this command belongs to
+    gchar *path;          // PLAYER_CMD_OPEN
+    gdouble fraction;     // PLAYER_CMD_SEEK: position as a fraction of the duration
+    gint64 offset;        // PLAYER_CMD_SEEK_RELATIVE: offset in nanoseconds
+    gdouble rate;         // PLAYER_CMD_SET_RATE
+    GstMessage *message;  // PLAYER_CMD_BUS_MESSAGE
+} PlayerCommand;
+
+// Updates posted from the controller thread back to the UI thread.
+typedef enum {
+    PLAYER_UPDATE_STARTED,
+    PLAYER_UPDATE_POSITION,
+    PLAYER_UPDATE_EOS,
+    PLAYER_UPDATE_STATS,
+    PLAYER_UPDATE_ERROR
+} PlayerUpdateType;
+
+// A decoded preview frame, keyed by position in whole seconds.
+typedef struct {
+    gint64 bucket;
+    GdkPixbuf *pixbuf;
+} PreviewFrame;
+
+// Hover preview state shared between the UI and the preview worker thread.
+// Everything except the worker-only fields is guarded by lock.
+typedef struct {
+    GThread *thread;
+    GMutex lock;
+    GCond cond;
+    gboolean quit;
+    gboolean sprites_enabled;
+    gchar *path;                // File to preview
+    guint path_serial;          // Bumped whenever path changes
+    gboolean has_request;
+    gint64 request_bucket;      // Only the latest hover request is kept
+    GHashTable *frames;         // bucket -> GList link in lru
+    GQueue lru;                 // PreviewFrame, most recently used first
+    GdkPixbuf *sprites[PREVIEW_SPRITE_FRAMES];
+    gint sprites_done;
+    gint64 sprites_duration;    // Duration the sprite frames were spaced over
+    
+    // Worker thread only.
+    GstElement *pipeline;
+    GstElement *sink;
+    gint64 duration;
+    GstTaskPool *task_pool;     // Runs the preview pipeline's streaming threads
+} PreviewCache;
 
 // Define the application structure
 typedef struct {
@@ -13,25 +182,69 @@ typedef struct {
     GtkWidget *stop_button;
     GtkWidget *volume_button;
     GtkWidget *progress_bar;
+    GtkWidget *progress_box;    // Event box receiving progress bar clicks and hovers
     GtkWidget *status_bar;
+    GtkWidget *info_bar;        // Non-modal error display
+    GtkWidget *info_label;
     GtkWidget *window;
     GList *video_list;
     GList *current_video;
     gdouble volume_level;
     gboolean is_playing;
     gboolean is_fullscreen;
+    gint64 duration;            // Last duration reported by the controller
+    gdouble rate;               // Playback rate, 1.0 is normal speed
+    gint64 startup_time;        // Time from open to playing, in microseconds
+    guint rebuffers;            // Stalls since playback started
+    gint buffer_percent;        // Below 100 while buffering
     
-    // Our custom pipeline
-    GstElement *pipeline;
-    GstBus *bus;
-    guint bus_watch_id;
-    guint timeout_id;
+    // Hover preview popup and the cache feeding it.
+    GtkWidget *preview_window;
+    GtkWidget *preview_image;
+    GtkWidget *preview_label;
+    gint64 preview_position;
+    PreviewCache preview;
+    
+    // Pipeline controller. The pipeline is only ever touched from the
+    // controller thread; the UI talks to it through the command queue.
+    GThread *controller;
+    GAsyncQueue *commands;
+    gint open_serial;           // Bumped atomically for every open request
+    GstElement *pipeline;       // Controller thread only
+    guint pipeline_serial;      // Controller thread only
+    gboolean pipeline_playing;  // Controller thread only
+    gdouble pipeline_rate;      // Controller thread only
+    gboolean rate_pending;      // Controller thread only: re-apply the rate once prerolled
+    StreamConfig stream;        // Read-only after startup
+    gint64 open_time;           // Controller thread only
+    gint64 pipeline_startup;    // Controller thread only
+    gboolean started;           // Controller thread only
+    gboolean buffering;         // Controller thread only
+    guint pipeline_rebuffers;   // Controller thread only
 } VynPlayerApp;
 
+typedef struct {
+    VynPlayerApp *app;
+    PlayerUpdateType type;
+    guint serial;
+    gint64 position;
+    gint64 duration;
+    GtkWidget *video_widget;    // PLAYER_UPDATE_STARTED, owns a reference
+    gchar *message;             // PLAYER_UPDATE_ERROR
+    gint64 startup_time;        // PLAYER_UPDATE_STATS
+    guint rebuffers;            // PLAYER_UPDATE_STATS
+    gint buffer_percent;        // PLAYER_UPDATE_STATS
+} PlayerUpdate;
+
 // Function prototypes
 static void update_video(VynPlayerApp *app, const gchar *path);
+static void player_open(VynPlayerApp *app, const gchar *path);
+static void reset_video_ui(VynPlayerApp *app, const gchar *path);
+static void load_video_list(VynPlayerApp *app, const gchar *filename);
+static void startup_trace(const gchar *event);
 static void update_status(VynPlayerApp *app);
 static void open_video(GtkWidget *widget, gpointer data);
+static void open_location(GtkWidget *widget, gpointer data);
 static void play_video(GtkWidget *widget, gpointer data);
 static void pause_video(GtkWidget *widget, gpointer data);
 static void stop_video(GtkWidget *widget, gpointer data);
@@ -39,117 +252,190 @@ static void toggle_fullscreen(GtkWidget *widget, gpointer data);
 static void volume_changed(GtkWidget *widget, gdouble value, gpointer data);
 static void navigate_video(GtkWidget *widget, gpointer data);
 static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer data);
-static gboolean update_progress(gpointer data);
-static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data);
-static gboolean embed_video_idle(gpointer data);
+static void update_progress(VynPlayerApp *app, gint64 position, gint64 duration);
+static void embed_video_widget(VynPlayerApp *app, GtkWidget *video_widget);
+static void show_error(VynPlayerApp *app, const gchar *message);
 static void cleanup_gstreamer(VynPlayerApp *app);
 static void seek_video(VynPlayerApp *app, gdouble position);
+static void change_rate(VynPlayerApp *app, gint step);
 static void play_next_video(VynPlayerApp *app);
 static void play_prev_video(VynPlayerApp *app);
 static gboolean progress_bar_click(GtkWidget *widget, GdkEventButton *event, gpointer data);
+static gboolean progress_bar_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data);
+static gboolean progress_bar_leave(GtkWidget *widget, GdkEventCrossing *event, gpointer data);
+static void preview_set_file(VynPlayerApp *app, const gchar *path);
+static void preview_shutdown(VynPlayerApp *app);
+static gpointer preview_thread(gpointer data);
+static void player_send(VynPlayerApp *app, PlayerCommand *cmd);
+static PlayerCommand *player_command_new(VynPlayerApp *app, PlayerCommandType type);
+static void player_command_free(PlayerCommand *cmd);
+static gpointer controller_thread(gpointer data);
+static gboolean apply_update_idle(gpointer data);
+
+// Allocate a command tagged with the current open request.
+static PlayerCommand *player_command_new(VynPlayerApp *app, PlayerCommandType type) {
+    PlayerCommand *cmd = g_new0(PlayerCommand, 1);
+    cmd->type = type;
+    cmd->serial = (guint)g_atomic_int_get(&app->open_serial);
+    return cmd;
+}
+
+static void player_command_free(PlayerCommand *cmd) {
+    g_free(cmd->path);
+    if (cmd->message)
+        gst_message_unref(cmd->message);
+    g_free(cmd);
+}
+
+// Queue a command for the controller thread. Never blocks.
+static void player_send(VynPlayerApp *app, PlayerCommand *cmd) {
+    if (cmd->type == PLAYER_CMD_QUIT)
+        g_async_queue_push_front(app->commands, cmd);
+    else
+        g_async_queue_push(app->commands, cmd);
+}
 
-// Update the current video by building a new pipeline from the given file path.
+// Update the current video by asking the controller to build a new pipeline
+// for the given file path. Returns immediately; the controller posts
+// PLAYER_UPDATE_STARTED once the pipeline is running.
 static void update_video(VynPlayerApp *app, const gchar *path) {
     if (!path)
         return;
     
+    player_open(app, path);
+    reset_video_ui(app, path);
+}
+
+// Queue an open request for the controller. Touches no widgets, so main()
+// can call it before the window exists.
+static void player_open(VynPlayerApp *app, const gchar *path) {
     g_print("Trying to play: %s\n", path);
     
-    // Stop and free any existing pipeline.
-    if (app->pipeline) {
-        gst_element_set_state(app->pipeline, GST_STATE_NULL);
-        gst_object_unref(app->pipeline);
-        app->pipeline = NULL;
-    }
-    
-    // Build the custom pipeline string using gtksink.
-    // (If gtksink still opens a separate window, try using "gtkglsink" here.)
-    gchar *pipeline_str = g_strdup_printf(
-        "filesrc location=\"%s\" ! qtdemux name=demux "
-        "demux.video_0 ! queue ! h264parse ! avdec_h264 ! videoconvert ! gtksink name=videosink "
-        "demux.audio_0 ! queue ! aacparse ! avdec_aac ! audioconvert ! audioresample ! autoaudiosink",
-        path);
-    
-    g_print("Pipeline: %s\n", pipeline_str);
-    app->pipeline = gst_parse_launch(pipeline_str, NULL);
-    g_free(pipeline_str);
-    
-    if (!app->pipeline) {
-        g_printerr("Failed to create pipeline!\n");
-        return;
-    }
-    
-    // Get the bus and add a watch.
-    app->bus = gst_element_get_bus(app->pipeline);
-    app->bus_watch_id = gst_bus_add_watch(app->bus, bus_call, app);
+    // A newer open supersedes any open still waiting in the queue, and
+    // makes updates from the old pipeline stale.
+    g_atomic_int_inc(&app->open_serial);
+    PlayerCommand *cmd = player_command_new(app, PLAYER_CMD_OPEN);
+    cmd->path = g_strdup(path);
+    player_send(app, cmd);
+}
+
+// Reset progress, stats and previews for a newly opened video.
+static void reset_video_ui(VynPlayerApp *app, const gchar *path) {
+    app->duration = 0;
+    app->startup_time = 0;
+    app->rebuffers = 0;
+    app->buffer_percent = 100;
+    // Previews decode local files only.
+    preview_set_file(app, gst_uri_is_valid(path) ? NULL : path);
     
-    // Start playing.
-    GstStateChangeReturn ret = gst_element_set_state(app->pipeline, GST_STATE_PLAYING);
-    if (ret == GST_STATE_CHANGE_FAILURE) {
-        g_printerr("Failed to start playback!\n");
-    } else {
-        app->is_playing = TRUE;
-        gtk_widget_set_sensitive(app->play_button, FALSE);
-        gtk_widget_set_sensitive(app->pause_button, TRUE);
-        gtk_widget_set_sensitive(app->stop_button, TRUE);
-        update_status(app);
-        // Delay embedding the sink widget until the pipeline is running.
-        g_idle_add(embed_video_idle, app);
-    }
+    gtk_widget_hide(app->info_bar);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->progress_bar), 0.0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->progress_bar), NULL);
+    update_status(app);
 }
 
-static gboolean embed_video_idle(gpointer data) {
-    VynPlayerApp *app = (VynPlayerApp *)data;
-    GstElement *videosink = gst_bin_get_by_name(GST_BIN(app->pipeline), "videosink");
-    if (videosink) {
-        GtkWidget *video_widget = NULL;
-        g_object_get(videosink, "widget", &video_widget, NULL);
-        if (video_widget) {
-            // Remove from any previous parent.
-            GtkWidget *current_parent = gtk_widget_get_parent(video_widget);
-            if (current_parent) {
-                gtk_container_remove(GTK_CONTAINER(current_parent), video_widget);
-                g_print("Removed gtksink widget from its previous parent\n");
-            }
-            // Hide the widget before reparenting.
-            gtk_widget_hide(video_widget);
-            // Clear any children from our container.
-            GList *children = gtk_container_get_children(GTK_CONTAINER(app->video_container));
-            for (GList *l = children; l; l = l->next)
-                gtk_container_remove(GTK_CONTAINER(app->video_container), GTK_WIDGET(l->data));
-            g_list_free(children);
-            // Add the widget into our container.
-            gtk_container_add(GTK_CONTAINER(app->video_container), video_widget);
-            gtk_widget_show_all(app->video_container);
-            g_print("Embedded gtksink widget into video container successfully\n");
-            // Get its toplevel window and hide it.
-            GtkWidget *toplevel = gtk_widget_get_toplevel(video_widget);
-            if (GTK_IS_WINDOW(toplevel) && toplevel != app->window) {
-                gtk_widget_hide(toplevel);
-                g_print("Hid extra toplevel window from gtksink\n");
-            }
-        } else {
-            g_warning("Failed to retrieve gtksink widget\n");
-        }
-        gst_object_unref(videosink);
-    } else {
-        g_warning("Failed to get videosink element from pipeline\n");
+// Move the sink's widget into our video container.
+static void embed_video_widget(VynPlayerApp *app, GtkWidget *video_widget) {
+    // Remove from any previous parent.
+    GtkWidget *current_parent = gtk_widget_get_parent(video_widget);
+    if (current_parent) {
+        gtk_container_remove(GTK_CONTAINER(current_parent), video_widget);
+        g_print("Removed gtksink widget from its previous parent\n");
+    }
+    // Hide the widget before reparenting.
+    gtk_widget_hide(video_widget);
+    // Clear any children from our container.
+    GList *children = gtk_container_get_children(GTK_CONTAINER(app->video_container));
+    for (GList *l = children; l; l = l->next)
+        gtk_container_remove(GTK_CONTAINER(app->video_container), GTK_WIDGET(l->data));
+    g_list_free(children);
+    // Add the widget into our container.
+    gtk_container_add(GTK_CONTAINER(app->video_container), video_widget);
+    gtk_widget_show_all(app->video_container);
+    g_print("Embedded gtksink widget into video container successfully\n");
+    // Get its toplevel window and hide it.
+    GtkWidget *toplevel = gtk_widget_get_toplevel(video_widget);
+    if (GTK_IS_WINDOW(toplevel) && toplevel != app->window) {
+        gtk_widget_hide(toplevel);
+        g_print("Hid extra toplevel window from gtksink\n");
     }
-    return G_SOURCE_REMOVE; // Run once.
 }
 
+// Show an error in the info bar without blocking the main loop.
+static void show_error(VynPlayerApp *app, const gchar *message) {
+    gchar *text = g_strdup_printf("Failed to play video: %s", message);
+    gtk_label_set_text(GTK_LABEL(app->info_label), text);
+    gtk_widget_show(app->info_bar);
+    g_free(text);
+}
 
+static void info_bar_response(GtkInfoBar *bar, gint response_id, gpointer data) {
+    (void)response_id;
+    (void)data;
+    gtk_widget_hide(GTK_WIDGET(bar));
+}
 
-// Update the status bar with the current video's basename.
+// Update the status bar with the current video's basename, rate and stream stats.
 static void update_status(VynPlayerApp *app) {
     if (app->current_video && app->current_video->data) {
         gchar *basename = g_path_get_basename((gchar *)app->current_video->data);
-        gchar *status = g_strdup_printf("Now playing: %s", basename);
+        GString *status = g_string_new(NULL);
+        g_string_printf(status, "Now playing: %s", basename);
+        if (app->rate != 1.0)
+            g_string_append_printf(status, " (%.2gx)", app->rate);
+        if (app->buffer_percent < 100)
+            g_string_append_printf(status, " - Buffering %d%%", app->buffer_percent);
+        if (app->startup_time > 0)
+            g_string_append_printf(status, " - Started in %.2f s, %u rebuffer%s",
+                                   app->startup_time / (gdouble)G_USEC_PER_SEC,
+                                   app->rebuffers, app->rebuffers == 1 ? "" : "s");
         gtk_statusbar_remove_all(GTK_STATUSBAR(app->status_bar), 0);
-        gtk_statusbar_push(GTK_STATUSBAR(app->status_bar), 0, status);
+        gtk_statusbar_push(GTK_STATUSBAR(app->status_bar), 0, status->str);
         g_free(basename);
-        g_free(status);
+        g_string_free(status, TRUE);
+    }
+}
+
+// Print a startup trace line. Safe to call from any thread.
+static void startup_trace(const gchar *event) {
+    if (trace_enabled)
+        g_printerr("[startup] %8.2f ms  %s\n",
+                   (g_get_monotonic_time() - trace_start) / 1000.0, event);
+}
+
+// Build the video list from the file's directory and select the file in it.
+static void load_video_list(VynPlayerApp *app, const gchar *filename) {
+    if (app->video_list) {
+        g_list_free_full(app->video_list, g_free);
+        app->video_list = NULL;
+        app->current_video = NULL;
+    }
+    
+    gchar *dir_path = g_path_get_dirname(filename);
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    if (dir) {
+        const gchar *entry;
+        while ((entry = g_dir_read_name(dir))) {
+            gchar *full_path = g_build_filename(dir_path, entry, NULL);
+            if (g_str_has_suffix(full_path, ".mp4") ||
+                g_str_has_suffix(full_path, ".mkv") ||
+                g_str_has_suffix(full_path, ".avi") ||
+                g_str_has_suffix(full_path, ".mov") ||
+                g_str_has_suffix(full_path, ".webm") ||
+                g_str_has_suffix(full_path, ".ogv")) {
+                app->video_list = g_list_append(app->video_list, full_path);
+            } else {
+                g_free(full_path);
+            }
+        }
+        g_dir_close(dir);
+        
+        app->video_list = g_list_sort(app->video_list, (GCompareFunc)g_strcmp0);
+        app->current_video = g_list_find_custom(app->video_list, filename, (GCompareFunc)g_strcmp0);
+        if (!app->current_video && app->video_list)
+            app->current_video = app->video_list;
     }
+    g_free(dir_path);
 }
 
 // Open a video file and build the video list from the file's directory.
@@ -173,55 +459,62 @@ static void open_video(GtkWidget *widget, gpointer data) {
     gtk_file_filter_add_pattern(filter, "*");
     gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filter);
     
-    // Clean up any existing video list.
-    if (app->video_list) {
-        g_list_free_full(app->video_list, g_free);
-        app->video_list = NULL;
-        app->current_video = NULL;
-    }
-    
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
         gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
         if (filename) {
-            gchar *dir_path = g_path_get_dirname(filename);
-            GDir *dir = g_dir_open(dir_path, 0, NULL);
-            if (dir) {
-                const gchar *entry;
-                while ((entry = g_dir_read_name(dir))) {
-                    gchar *full_path = g_build_filename(dir_path, entry, NULL);
-                    if (g_str_has_suffix(full_path, ".mp4") || 
-                        g_str_has_suffix(full_path, ".mkv") ||
-                        g_str_has_suffix(full_path, ".avi") ||
-                        g_str_has_suffix(full_path, ".mov") ||
-                        g_str_has_suffix(full_path, ".webm") ||
-                        g_str_has_suffix(full_path, ".ogv")) {
-                        app->video_list = g_list_append(app->video_list, full_path);
-                    } else {
-                        g_free(full_path);
-                    }
-                }
-                g_dir_close(dir);
-                
-                app->video_list = g_list_sort(app->video_list, (GCompareFunc)g_strcmp0);
-                app->current_video = g_list_find_custom(app->video_list, filename, (GCompareFunc)g_strcmp0);
-                if (!app->current_video && app->video_list)
-                    app->current_video = app->video_list;
-                
-                if (app->current_video)
-                    update_video(app, (gchar *)app->current_video->data);
-            }
-            g_free(dir_path);
+            load_video_list(app, filename);
+            if (app->current_video)
+                update_video(app, (gchar *)app->current_video->data);
             g_free(filename);
         }
     }
     gtk_widget_destroy(dialog);
 }
 
+// Open a URI (file://, http(s):// or an HLS/DASH manifest) entered by the user.
+static void open_location(GtkWidget *widget, gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Open Location",
+                                                    GTK_WINDOW(app->window),
+                                                    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                    "_Cancel", GTK_RESPONSE_CANCEL,
+                                                    "_Open", GTK_RESPONSE_ACCEPT,
+                                                    NULL);
+    GtkWidget *entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "https://example.com/stream.m3u8");
+    gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+    gtk_entry_set_width_chars(GTK_ENTRY(entry), 50);
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+    gtk_container_add(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), entry);
+    gtk_widget_show_all(dialog);
+    
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        gchar *uri = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))));
+        if (gst_uri_is_valid(uri)) {
+            // Local files keep using the tuned file pipeline.
+            gchar *location = g_str_has_prefix(uri, "file://")
+                              ? g_filename_from_uri(uri, NULL, NULL)
+                              : g_strdup(uri);
+            if (location) {
+                if (app->video_list)
+                    g_list_free_full(app->video_list, g_free);
+                app->video_list = g_list_append(NULL, location);
+                app->current_video = app->video_list;
+                update_video(app, location);
+            }
+        } else {
+            show_error(app, "not a valid URI");
+        }
+        g_free(uri);
+    }
+    gtk_widget_destroy(dialog);
+}
+
 // Play the video.
 static void play_video(GtkWidget *widget, gpointer data) {
     VynPlayerApp *app = (VynPlayerApp *)data;
-    if (app->pipeline && !app->is_playing) {
-        gst_element_set_state(app->pipeline, GST_STATE_PLAYING);
+    if (app->current_video && !app->is_playing) {
+        player_send(app, player_command_new(app, PLAYER_CMD_PLAY));
         app->is_playing = TRUE;
         gtk_widget_set_sensitive(app->play_button, FALSE);
         gtk_widget_set_sensitive(app->pause_button, TRUE);
@@ -232,8 +525,8 @@ static void play_video(GtkWidget *widget, gpointer data) {
 // Pause the video.
 static void pause_video(GtkWidget *widget, gpointer data) {
     VynPlayerApp *app = (VynPlayerApp *)data;
-    if (app->pipeline && app->is_playing) {
-        gst_element_set_state(app->pipeline, GST_STATE_PAUSED);
+    if (app->current_video && app->is_playing) {
+        player_send(app, player_command_new(app, PLAYER_CMD_PAUSE));
         app->is_playing = FALSE;
         gtk_widget_set_sensitive(app->play_button, TRUE);
         gtk_widget_set_sensitive(app->pause_button, FALSE);
@@ -244,8 +537,8 @@ static void pause_video(GtkWidget *widget, gpointer data) {
 // Stop the video playback.
 static void stop_video(GtkWidget *widget, gpointer data) {
     VynPlayerApp *app = (VynPlayerApp *)data;
-    if (app->pipeline) {
-        gst_element_set_state(app->pipeline, GST_STATE_NULL);
+    if (app->current_video) {
+        player_send(app, player_command_new(app, PLAYER_CMD_STOP));
         app->is_playing = FALSE;
         gtk_widget_set_sensitive(app->play_button, TRUE);
         gtk_widget_set_sensitive(app->pause_button, FALSE);
@@ -309,14 +602,30 @@ static void play_prev_video(VynPlayerApp *app) {
 
 // Seek to a specific position in the video.
 static void seek_video(VynPlayerApp *app, gdouble position) {
-    if (!app->pipeline)
+    if (!app->current_video)
         return;
     
-    gint64 duration;
-    if (gst_element_query_duration(app->pipeline, GST_FORMAT_TIME, &duration))
-        gst_element_seek_simple(app->pipeline, GST_FORMAT_TIME,
-                                GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
-                                (gint64)(position * duration));
+    PlayerCommand *cmd = player_command_new(app, PLAYER_CMD_SEEK);
+    cmd->fraction = position;
+    player_send(app, cmd);
+}
+
+// Step the playback rate up or down through playback_rates, or reset it with step 0.
+static void change_rate(VynPlayerApp *app, gint step) {
+    gint count = G_N_ELEMENTS(playback_rates);
+    gint index = 0;
+    while (index < count - 1 && playback_rates[index] < app->rate)
+        index++;
+    index = step ? CLAMP(index + step, 0, count - 1) : 3; // playback_rates[3] is 1.0x
+    
+    if (playback_rates[index] == app->rate)
+        return;
+    app->rate = playback_rates[index];
+    
+    PlayerCommand *cmd = player_command_new(app, PLAYER_CMD_SET_RATE);
+    cmd->rate = app->rate;
+    player_send(app, cmd);
+    update_status(app);
 }
 
 // Progress bar click handler for seeking.
@@ -345,27 +654,27 @@ static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer
             return TRUE;
         case GDK_KEY_Left:
         case GDK_KEY_KP_Left: {
-            gint64 position;
-            if (gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position)) {
-                position = MAX(0, position - 10 * GST_SECOND);
-                gst_element_seek_simple(app->pipeline, GST_FORMAT_TIME,
-                                        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
-                                        position);
-            }
+            PlayerCommand *cmd = player_command_new(app, PLAYER_CMD_SEEK_RELATIVE);
+            cmd->offset = -10 * GST_SECOND;
+            player_send(app, cmd);
             return TRUE;
         }
         case GDK_KEY_Right:
         case GDK_KEY_KP_Right: {
-            gint64 position, duration;
-            if (gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position) &&
-                gst_element_query_duration(app->pipeline, GST_FORMAT_TIME, &duration)) {
-                position = MIN(duration, position + 10 * GST_SECOND);
-                gst_element_seek_simple(app->pipeline, GST_FORMAT_TIME,
-                                        GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
-                                        position);
-            }
+            PlayerCommand *cmd = player_command_new(app, PLAYER_CMD_SEEK_RELATIVE);
+            cmd->offset = 10 * GST_SECOND;
+            player_send(app, cmd);
             return TRUE;
         }
+        case GDK_KEY_bracketright:
+            change_rate(app, 1);
+            return TRUE;
+        case GDK_KEY_bracketleft:
+            change_rate(app, -1);
+            return TRUE;
+        case GDK_KEY_BackSpace:
+            change_rate(app, 0);
+            return TRUE;
         case GDK_KEY_Up:
         case GDK_KEY_KP_Up:
             app->volume_level = MIN(1.0, app->volume_level + 0.05);
@@ -384,6 +693,12 @@ static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer
             if (event->state & GDK_CONTROL_MASK)
                 gtk_main_quit();
             return TRUE;
+        case GDK_KEY_l:
+            if (event->state & GDK_CONTROL_MASK) {
+                open_location(NULL, app);
+                return TRUE;
+            }
+            return FALSE;
         case GDK_KEY_n:
         case GDK_KEY_N:
             play_next_video(app);
@@ -401,124 +716,1926 @@ static gboolean key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer
     }
 }
 
-// Update progress bar and time display.
-static gboolean update_progress(gpointer data) {
-    VynPlayerApp *app = (VynPlayerApp *)data;
-    if (app->pipeline && app->is_playing) {
-        gint64 position, duration;
-        if (gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position) &&
-            gst_element_query_duration(app->pipeline, GST_FORMAT_TIME, &duration) &&
-            duration > 0) {
-            gdouble progress = (gdouble)position / (gdouble)duration;
-            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->progress_bar), progress);
-            
-            gint pos_hours = position / (3600 * GST_SECOND);
-            gint pos_minutes = (position / (60 * GST_SECOND)) % 60;
-            gint pos_seconds = (position / GST_SECOND) % 60;
-            gint dur_hours = duration / (3600 * GST_SECOND);
-            gint dur_minutes = (duration / (60 * GST_SECOND)) % 60;
-            gint dur_seconds = (duration / GST_SECOND) % 60;
-            
-            gchar *time_str = g_strdup_printf("%02d:%02d:%02d / %02d:%02d:%02d",
-                                             pos_hours, pos_minutes, pos_seconds,
-                                             dur_hours, dur_minutes, dur_seconds);
-            gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->progress_bar), time_str);
-            g_free(time_str);
-            
-            if (position >= duration - GST_SECOND/2)
+// Update progress bar and time display from a position reported by the controller.
+static void update_progress(VynPlayerApp *app, gint64 position, gint64 duration) {
+    if (!app->is_playing || duration <= 0)
+        return;
+    app->duration = duration;
+    
+    gdouble progress = (gdouble)position / (gdouble)duration;
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->progress_bar), progress);
+    
+    gint pos_hours = position / (3600 * GST_SECOND);
+    gint pos_minutes = (position / (60 * GST_SECOND)) % 60;
+    gint pos_seconds = (position / GST_SECOND) % 60;
+    gint dur_hours = duration / (3600 * GST_SECOND);
+    gint dur_minutes = (duration / (60 * GST_SECOND)) % 60;
+    gint dur_seconds = (duration / GST_SECOND) % 60;
+    
+    gchar *time_str = g_strdup_printf("%02d:%02d:%02d / %02d:%02d:%02d",
+                                     pos_hours, pos_minutes, pos_seconds,
+                                     dur_hours, dur_minutes, dur_seconds);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->progress_bar), time_str);
+    g_free(time_str);
+    
+    if (position >= duration - GST_SECOND/2)
+        play_next_video(app);
+}
+
+// Apply an update posted by the controller thread. Runs on the UI thread.
+static gboolean apply_update_idle(gpointer data) {
+    PlayerUpdate *update = (PlayerUpdate *)data;
+    VynPlayerApp *app = update->app;
+    
+    // Updates from a pipeline that has since been replaced are stale.
+    if (update->serial == (guint)g_atomic_int_get(&app->open_serial)) {
+        switch (update->type) {
+            case PLAYER_UPDATE_STARTED:
+                app->is_playing = TRUE;
+                gtk_widget_set_sensitive(app->play_button, FALSE);
+                gtk_widget_set_sensitive(app->pause_button, TRUE);
+                gtk_widget_set_sensitive(app->stop_button, TRUE);
+                update_status(app);
+                if (update->video_widget)
+                    embed_video_widget(app, update->video_widget);
+                break;
+            case PLAYER_UPDATE_POSITION:
+                update_progress(app, update->position, update->duration);
+                break;
+            case PLAYER_UPDATE_EOS:
                 play_next_video(app);
+                break;
+            case PLAYER_UPDATE_STATS:
+                app->startup_time = update->startup_time;
+                app->rebuffers = update->rebuffers;
+                app->buffer_percent = update->buffer_percent;
+                update_status(app);
+                break;
+            case PLAYER_UPDATE_ERROR:
+                app->is_playing = FALSE;
+                gtk_widget_set_sensitive(app->play_button, TRUE);
+                gtk_widget_set_sensitive(app->pause_button, FALSE);
+                gtk_widget_set_sensitive(app->stop_button, FALSE);
+                show_error(app, update->message);
+                break;
         }
     }
-    return TRUE;
+    
+    if (update->video_widget)
+        g_object_unref(update->video_widget);
+    g_free(update->message);
+    g_free(update);
+    return G_SOURCE_REMOVE;
 }
 
-// GStreamer bus callback to handle EOS and errors.
-static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
-    VynPlayerApp *app = (VynPlayerApp *)data;
+// Post an update to the UI thread. Called from the controller thread.
+static void controller_post(VynPlayerApp *app, PlayerUpdateType type, guint serial,
+                            GtkWidget *video_widget, const gchar *message) {
+    PlayerUpdate *update = g_new0(PlayerUpdate, 1);
+    update->app = app;
+    update->type = type;
+    update->serial = serial;
+    update->video_widget = video_widget;
+    update->message = g_strdup(message);
+    g_idle_add(apply_update_idle, update);
+}
+
+// Report the playback position to the UI. Called from the controller thread.
+static void controller_post_position(VynPlayerApp *app) {
+    gint64 position, duration;
+    if (!app->pipeline || !app->pipeline_playing)
+        return;
+    if (gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position) &&
+        gst_element_query_duration(app->pipeline, GST_FORMAT_TIME, &duration)) {
+        PlayerUpdate *update = g_new0(PlayerUpdate, 1);
+        update->app = app;
+        update->type = PLAYER_UPDATE_POSITION;
+        update->serial = app->pipeline_serial;
+        update->position = position;
+        update->duration = duration;
+        g_idle_add(apply_update_idle, update);
+    }
+}
+
+// Report startup time, rebuffers and buffering level. Called from the controller thread.
+static void controller_post_stats(VynPlayerApp *app, gint buffer_percent) {
+    PlayerUpdate *update = g_new0(PlayerUpdate, 1);
+    update->app = app;
+    update->type = PLAYER_UPDATE_STATS;
+    update->serial = app->pipeline_serial;
+    update->startup_time = app->started ? app->pipeline_startup : 0;
+    update->rebuffers = app->pipeline_rebuffers;
+    update->buffer_percent = buffer_percent;
+    g_idle_add(apply_update_idle, update);
+}
+
+// Forward EOS, errors, buffering and pipeline state changes from GStreamer's
+// streaming threads into the command queue so they are handled in order with
+// user commands.
+static GstBusSyncReply controller_bus_sync(GstBus *bus, GstMessage *msg, gpointer data) {
+    GAsyncQueue *commands = (GAsyncQueue *)data;
     switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_STATE_CHANGED:
+            if (!GST_IS_PIPELINE(GST_MESSAGE_SRC(msg)))
+                break;
+            // fall through
         case GST_MESSAGE_EOS:
-            play_next_video(app);
-            break;
+        case GST_MESSAGE_BUFFERING:
         case GST_MESSAGE_ERROR: {
-            gchar *debug;
-            GError *error;
-            gst_message_parse_error(msg, &error, &debug);
-            g_free(debug);
-            g_printerr("Error: %s\n", error->message);
-            GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                                                       GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                       GTK_MESSAGE_ERROR,
-                                                       GTK_BUTTONS_CLOSE,
-                                                       "Failed to play video: %s",
-                                                       error->message);
-            gtk_dialog_run(GTK_DIALOG(dialog));
-            gtk_widget_destroy(dialog);
-            g_error_free(error);
+            PlayerCommand *cmd = g_new0(PlayerCommand, 1);
+            cmd->type = PLAYER_CMD_BUS_MESSAGE;
+            cmd->serial = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(bus), "vyn-serial"));
+            cmd->message = gst_message_ref(msg);
+            g_async_queue_push(commands, cmd);
             break;
         }
         default:
             break;
     }
-    return TRUE;
+    return GST_BUS_DROP;
 }
 
-// Clean up GStreamer resources.
-static void cleanup_gstreamer(VynPlayerApp *app) {
-    if (app->timeout_id > 0) {
-        g_source_remove(app->timeout_id);
-        app->timeout_id = 0;
+// Stop and free the current pipeline. Called from the controller thread.
+static void controller_teardown(VynPlayerApp *app) {
+    if (!app->pipeline)
+        return;
+    
+    GstBus *bus = gst_element_get_bus(app->pipeline);
+    gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+    gst_object_unref(bus);
+    
+    gst_element_set_state(app->pipeline, GST_STATE_NULL);
+    gst_object_unref(app->pipeline);
+    app->pipeline = NULL;
+    app->pipeline_playing = FALSE;
+    app->rate_pending = FALSE;
+}
+
+// Extra seek flags for a playback rate. Fast rates only decode keyframes to cap CPU use.
+static GstSeekFlags controller_rate_flags(gdouble rate) {
+    if (rate > TRICKMODE_RATE)
+        return GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS;
+    return GST_SEEK_FLAG_NONE;
+}
+
+// Flushing seek to a position at the current playback rate. Called from the controller thread.
+static gboolean controller_seek(VynPlayerApp *app, gint64 position, GstSeekFlags flags) {
+    return gst_element_seek(app->pipeline, app->pipeline_rate, GST_FORMAT_TIME,
+                            flags | GST_SEEK_FLAG_FLUSH | controller_rate_flags(app->pipeline_rate),
+                            GST_SEEK_TYPE_SET, position,
+                            GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+}
+
+// Re-apply a non-default rate to a freshly started pipeline once it reaches
+// PAUSED. The seek only takes after preroll, which can take a while on a
+// network stream, so this waits for the state change on the bus rather than
+// blocking the command queue. Called from the controller thread.
+static void controller_apply_rate(VynPlayerApp *app) {
+    GstState state;
+    if (!app->rate_pending || app->pipeline_rate == 1.0)
+        return;
+    // State changes queued before a restart can arrive late; check the
+    // pipeline itself without waiting.
+    if (gst_element_get_state(app->pipeline, &state, NULL, 0) != GST_STATE_CHANGE_SUCCESS ||
+        state < GST_STATE_PAUSED)
+        return;
+    app->rate_pending = FALSE;
+    gint64 position;
+    if (!gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position))
+        position = 0;
+    controller_seek(app, position, GST_SEEK_FLAG_ACCURATE);
+}
+
+// Change the playback rate. Called from the controller thread.
+static void controller_set_rate(VynPlayerApp *app, gdouble rate) {
+    gdouble old_rate = app->pipeline_rate;
+    app->pipeline_rate = rate;
+    if (!app->pipeline)
+        return;
+
+#if GST_CHECK_VERSION(1, 18, 0)
+    // Without a change of decode mode the rate can switch without flushing.
+    if (app->pipeline_playing && controller_rate_flags(rate) == controller_rate_flags(old_rate) &&
+        gst_element_seek(app->pipeline, rate, GST_FORMAT_TIME, GST_SEEK_FLAG_INSTANT_RATE_CHANGE,
+                         GST_SEEK_TYPE_NONE, 0, GST_SEEK_TYPE_NONE, 0))
+        return;
+#else
+    (void)old_rate;
+#endif
+    
+    gint64 position;
+    if (gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position))
+        controller_seek(app, position, GST_SEEK_FLAG_ACCURATE);
+}
+
+// Set an object property only if this element version has it.
+static void set_property_if_exists(GObject *object, const gchar *name, const GValue *value) {
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(object), name))
+        g_object_set_property(object, name, value);
+}
+
+// Configure network sources, download buffers and adaptive demuxers as
+// uridecodebin3 creates them. Runs on whichever thread adds the element.
+static void controller_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    const StreamConfig *config = &app->stream;
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *name = factory ? GST_OBJECT_NAME(factory) : "";
+    GValue value = G_VALUE_INIT;
+    (void)bin;
+    (void)sub_bin;
+    
+    if (g_str_equal(name, "urisourcebin") && config->cache_dir) {
+        // Spill progressive downloads to an on-disk ring buffer.
+        g_object_set(element, "download", TRUE, NULL);
+        g_value_init(&value, G_TYPE_UINT64);
+        g_value_set_uint64(&value, (guint64)config->cache_size_mb * 1024 * 1024);
+        set_property_if_exists(G_OBJECT(element), "ring-buffer-max-size", &value);
+        g_value_unset(&value);
+    } else if ((g_str_equal(name, "queue2") || g_str_equal(name, "downloadbuffer")) && config->cache_dir) {
+        gchar *template = g_build_filename(config->cache_dir, "vynplayer-XXXXXX", NULL);
+        g_object_set(element, "temp-template", template, NULL);
+        g_free(template);
+    } else if (g_str_equal(name, "souphttpsrc")) {
+        g_object_set(element, "retries", 5, "timeout", 15, NULL);
+    } else if (g_str_has_prefix(name, "hlsdemux") || g_str_has_prefix(name, "dashdemux")) {
+        // Variant selection: stay below 80% of the measured bandwidth.
+        g_value_init(&value, G_TYPE_FLOAT);
+        g_value_set_float(&value, 0.8f);
+        set_property_if_exists(G_OBJECT(element), "bandwidth-target-ratio", &value);
+        g_value_unset(&value);
+        if (config->max_bitrate > 0) {
+            g_value_init(&value, G_TYPE_UINT);
+            g_value_set_uint(&value, (guint)config->max_bitrate);
+            set_property_if_exists(G_OBJECT(element), "max-bitrate", &value);
+            g_value_unset(&value);
+        }
+        // adaptivedemux2 downloads audio and video segments in parallel; this
+        // sets how far ahead of playback it prefetches.
+        g_value_init(&value, G_TYPE_UINT64);
+        g_value_set_uint64(&value, (guint64)config->prefetch_seconds * GST_SECOND);
+        set_property_if_exists(G_OBJECT(element), "high-watermark-time", &value);
+        g_value_unset(&value);
+    }
+}
+
+// Track buffering for network streams: pause while the buffer refills and
+// count every stall after playback started. Called from the controller thread.
+static void controller_buffering(VynPlayerApp *app, gint percent) {
+    if (percent < 100 && !app->buffering) {
+        app->buffering = TRUE;
+        if (app->started)
+            app->pipeline_rebuffers++;
+        if (app->pipeline_playing)
+            gst_element_set_state(app->pipeline, GST_STATE_PAUSED);
+    } else if (percent >= 100 && app->buffering) {
+        app->buffering = FALSE;
+        if (app->pipeline_playing)
+            gst_element_set_state(app->pipeline, GST_STATE_PLAYING);
     }
-    if (app->bus_watch_id > 0) {
-        g_source_remove(app->bus_watch_id);
-        app->bus_watch_id = 0;
+    controller_post_stats(app, percent);
+}
+
+// Trace the first video buffer reaching the sink.
+static GstPadProbeReturn first_frame_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    (void)pad;
+    (void)info;
+    (void)data;
+    startup_trace("first frame");
+    return GST_PAD_PROBE_REMOVE;
+}
+
+// Load the plugins behind the playback pipeline so the first open does not
+// pay for it. Called from the controller thread while it has nothing queued.
+static void controller_prewarm(void) {
+    GstRegistry *registry = gst_registry_get();
+    for (guint i = 0; i < G_N_ELEMENTS(prewarm_elements); i++) {
+        GstPluginFeature *feature = gst_registry_lookup_feature(registry, prewarm_elements[i]);
+        if (!feature)
+            continue;
+        GstPluginFeature *loaded = gst_plugin_feature_load(feature);
+        if (loaded)
+            gst_object_unref(loaded);
+        gst_object_unref(feature);
     }
-    if (app->pipeline) {
-        gst_element_set_state(app->pipeline, GST_STATE_NULL);
-        gst_object_unref(app->pipeline);
-        app->pipeline = NULL;
+    startup_trace("decoder plugins prewarmed");
+}
+
+// Describe the decode chain for a file or URI, ending each branch in the
+// given elements. Local files take the tuned MP4/H.264/AAC chain; network
+// and adaptive streams go through uridecodebin3, configured in
+// controller_element_added. A NULL audio_tail leaves audio out. The source
+// is left without a location; set it with decode_pipeline_set_location.
+static gchar *decode_pipeline_description(const gchar *location, const gchar *video_tail,
+                                          const gchar *audio_tail) {
+    GString *desc = g_string_new(NULL);
+    if (gst_uri_is_valid(location)) {
+        g_string_append_printf(desc, "uridecodebin3 name=src "
+                               "src. ! video/x-raw ! queue name=videoqueue ! %s", video_tail);
+        if (audio_tail)
+            g_string_append_printf(desc, " src. ! audio/x-raw ! queue name=audioqueue ! %s", audio_tail);
+    } else {
+        g_string_append_printf(desc, "filesrc name=src ! qtdemux name=demux "
+                               "demux.video_0 ! queue name=videoqueue ! h264parse ! avdec_h264 ! %s",
+                               video_tail);
+        if (audio_tail)
+            g_string_append_printf(desc, " demux.audio_0 ! queue name=audioqueue ! aacparse ! avdec_aac ! %s",
+                                   audio_tail);
     }
-    if (app->video_list) {
-        g_list_free_full(app->video_list, g_free);
-        app->video_list = NULL;
-        app->current_video = NULL;
+    return g_string_free(desc, FALSE);
+}
+
+// Point an element at a file. Paths are set as properties rather than
+// written into a pipeline description, where quotes and backslashes in a
+// file name would break the parse.
+static void set_element_location(GstElement *bin, const gchar *name, const gchar *location) {
+    GstElement *element = gst_bin_get_by_name(GST_BIN(bin), name);
+    if (element) {
+        g_object_set(element, "location", location, NULL);
+        gst_object_unref(element);
     }
 }
 
-// Main function.
-int main(int argc, char *argv[]) {
-    GtkWidget *toolbar;
-    GtkWidget *vbox;
-    VynPlayerApp app = {0};
-    GtkToolItem *open_toolitem, *prev_toolitem, *next_toolitem, *play_toolitem,
-                *pause_toolitem, *stop_toolitem, *fullscreen_toolitem, *separator;
-    
-    gtk_init(&argc, &argv);
-    gst_init(&argc, &argv);
+// Set the file or URI a decode_pipeline_description pipeline reads.
+static void decode_pipeline_set_location(GstElement *pipeline, const gchar *location) {
+    if (gst_uri_is_valid(location)) {
+        GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+        g_object_set(src, "uri", location, NULL);
+        gst_object_unref(src);
+    } else {
+        set_element_location(pipeline, "src", location);
+    }
+}
+
+// Build and start a pipeline for the given file. Called from the controller thread.
+static void controller_open(VynPlayerApp *app, PlayerCommand *cmd) {
+    // Skip opens that a newer request has already superseded.
+    if (cmd->serial != (guint)g_atomic_int_get(&app->open_serial))
+        return;
     
-    g_print("Vyn Player starting...\n");
+    controller_teardown(app);
+    app->pipeline_serial = cmd->serial;
+    app->open_time = g_get_monotonic_time();
+    app->started = FALSE;
+    app->buffering = FALSE;
+    app->pipeline_rebuffers = 0;
     
-    // Create main window.
-    app.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    gtk_window_set_title(GTK_WINDOW(app.window), "Vyn Player");
-    gtk_window_set_default_size(GTK_WINDOW(app.window), 800, 600);
-    g_signal_connect(app.window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
-    g_signal_connect(app.window, "key-press-event", G_CALLBACK(key_press_event), &app);
+    // Build the custom pipeline string using gtksink.
+    // (If gtksink still opens a separate window, try using "gtkglsink" here.)
+    gchar *pipeline_str = decode_pipeline_description(
+        cmd->path,
+        "videoconvert ! gtksink name=videosink",
+        "audioconvert ! scaletempo ! audioconvert ! audioresample ! autoaudiosink");
     
-    // Create main container.
-    vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-    gtk_container_add(GTK_CONTAINER(app.window), vbox);
+    g_print("Pipeline: %s\n", pipeline_str);
+    GError *error = NULL;
+    app->pipeline = gst_parse_launch(pipeline_str, &error);
+    g_free(pipeline_str);
     
-    // Create toolbar.
-    toolbar = gtk_toolbar_new();
-    gtk_box_pack_start(GTK_BOX(vbox), toolbar, FALSE, FALSE, 0);
+    if (!app->pipeline) {
+        g_printerr("Failed to create pipeline!\n");
+        controller_post(app, PLAYER_UPDATE_ERROR, cmd->serial, NULL,
+                        error ? error->message : "could not create pipeline");
+        g_clear_error(&error);
+        return;
+    }
+    if (error) {
+        g_printerr("Pipeline warning: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    decode_pipeline_set_location(app->pipeline, cmd->path);
+    g_signal_connect(app->pipeline, "deep-element-added", G_CALLBACK(controller_element_added), app);
+    startup_trace("pipeline built");
+    if (trace_enabled) {
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(app->pipeline), "videosink");
+        GstPad *pad = sink ? gst_element_get_static_pad(sink, "sink") : NULL;
+        if (pad) {
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, first_frame_probe, NULL, NULL);
+            gst_object_unref(pad);
+        }
+        if (sink)
+            gst_object_unref(sink);
+    }
     
-    // Toolbar buttons.
-    open_toolitem = gtk_tool_button_new(gtk_image_new_from_icon_name("document-open", GTK_ICON_SIZE_LARGE_TOOLBAR), "Open");
-    g_signal_connect(open_toolitem, "clicked", G_CALLBACK(open_video), &app);
-    gtk_toolbar_insert(GTK_TOOLBAR(toolbar), GTK_TOOL_ITEM(open_toolitem), -1);
+    // Route bus messages into our command queue, tagged with this open request.
+    GstBus *bus = gst_element_get_bus(app->pipeline);
+    g_object_set_data(G_OBJECT(bus), "vyn-serial", GUINT_TO_POINTER(cmd->serial));
+    gst_bus_set_sync_handler(bus, controller_bus_sync,
+                             g_async_queue_ref(app->commands),
+                             (GDestroyNotify)g_async_queue_unref);
+    gst_object_unref(bus);
     
-    separator = gtk_separator_tool_item_new();
-    gtk_toolbar_insert(GTK_TOOLBAR(toolbar), GTK_TOOL_ITEM(separator), -1);
+    // Start playing.
+    GstStateChangeReturn ret = gst_element_set_state(app->pipeline, GST_STATE_PLAYING);
+    if (ret == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to start playback!\n");
+        controller_teardown(app);
+        controller_post(app, PLAYER_UPDATE_ERROR, cmd->serial, NULL, "failed to start playback");
+        return;
+    }
+    app->pipeline_playing = TRUE;
+    
+    // gtksink creates its widget through g_main_context_invoke on the
+    // default context, which main() owns until gtk_main() returns, so the
+    // widget is always built on the main thread. Before the main loop runs,
+    // the state change above waits for it.
+    GtkWidget *video_widget = NULL;
+    GstElement *videosink = gst_bin_get_by_name(GST_BIN(app->pipeline), "videosink");
+    if (videosink) {
+        g_object_get(videosink, "widget", &video_widget, NULL);
+        startup_trace("video widget created");
+        if (!video_widget)
+            g_warning("Failed to retrieve gtksink widget\n");
+        gst_object_unref(videosink);
+    } else {
+        g_warning("Failed to get videosink element from pipeline\n");
+    }
+    controller_post(app, PLAYER_UPDATE_STARTED, cmd->serial, video_widget, NULL);
+    app->rate_pending = TRUE;
+}
+
+// Seek by an offset from the current position. Called from the controller thread.
+static void controller_seek_relative(VynPlayerApp *app, gint64 offset) {
+    gint64 position, duration;
+    if (!gst_element_query_position(app->pipeline, GST_FORMAT_TIME, &position))
+        return;
+    position += offset;
+    if (gst_element_query_duration(app->pipeline, GST_FORMAT_TIME, &duration))
+        position = MIN(duration, position);
+    position = MAX(0, position);
+    controller_seek(app, position, GST_SEEK_FLAG_KEY_UNIT);
+}
+
+// Handle EOS and errors from the current pipeline. Called from the controller thread.
+static void controller_bus_message(VynPlayerApp *app, PlayerCommand *cmd) {
+    GstMessage *msg = cmd->message;
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_EOS:
+            controller_post(app, PLAYER_UPDATE_EOS, cmd->serial, NULL, NULL);
+            break;
+        case GST_MESSAGE_BUFFERING: {
+            gint percent;
+            gst_message_parse_buffering(msg, &percent);
+            controller_buffering(app, percent);
+            break;
+        }
+        case GST_MESSAGE_STATE_CHANGED: {
+            GstState new_state;
+            gst_message_parse_state_changed(msg, NULL, &new_state, NULL);
+            if (new_state >= GST_STATE_PAUSED)
+                controller_apply_rate(app);
+            if (new_state == GST_STATE_PLAYING && !app->started) {
+                // Startup time: open request to the first PLAYING transition.
+                app->started = TRUE;
+                app->pipeline_startup = g_get_monotonic_time() - app->open_time;
+                controller_post_stats(app, 100);
+            }
+            break;
+        }
+        case GST_MESSAGE_ERROR: {
+            gchar *debug;
+            GError *error;
+            gst_message_parse_error(msg, &error, &debug);
+            g_free(debug);
+            g_printerr("Error: %s\n", error->message);
+            controller_teardown(app);
+            controller_post(app, PLAYER_UPDATE_ERROR, cmd->serial, NULL, error->message);
+            g_error_free(error);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Execute one command. Returns FALSE when the controller should exit.
+static gboolean controller_handle(VynPlayerApp *app, PlayerCommand *cmd) {
+    if (cmd->type == PLAYER_CMD_QUIT)
+        return FALSE;
+    if (cmd->type == PLAYER_CMD_OPEN) {
+        controller_open(app, cmd);
+        return TRUE;
+    }
+    if (cmd->type == PLAYER_CMD_SET_RATE) {
+        controller_set_rate(app, cmd->rate);
+        return TRUE;
+    }
+    
+    // Everything else applies to the current pipeline only.
+    if (!app->pipeline || cmd->serial != app->pipeline_serial)
+        return TRUE;
+    
+    switch (cmd->type) {
+        case PLAYER_CMD_PLAY: {
+            // Restarting after stop begins a new segment at normal speed.
+            GstState state;
+            gst_element_get_state(app->pipeline, &state, NULL, 0);
+            if (gst_element_set_state(app->pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+                app->pipeline_playing = TRUE;
+                if (state <= GST_STATE_READY)
+                    app->rate_pending = TRUE;
+            }
+            break;
+        }
+        case PLAYER_CMD_PAUSE:
+            gst_element_set_state(app->pipeline, GST_STATE_PAUSED);
+            app->pipeline_playing = FALSE;
+            break;
+        case PLAYER_CMD_STOP:
+            gst_element_set_state(app->pipeline, GST_STATE_NULL);
+            app->pipeline_playing = FALSE;
+            break;
+        case PLAYER_CMD_SEEK: {
+            gint64 duration;
+            if (gst_element_query_duration(app->pipeline, GST_FORMAT_TIME, &duration))
+                controller_seek(app, (gint64)(cmd->fraction * duration), GST_SEEK_FLAG_KEY_UNIT);
+            break;
+        }
+        case PLAYER_CMD_SEEK_RELATIVE:
+            controller_seek_relative(app, cmd->offset);
+            break;
+        case PLAYER_CMD_BUS_MESSAGE:
+            controller_bus_message(app, cmd);
+            break;
+        default:
+            break;
+    }
+    return TRUE;
+}
+
+// Controller thread: owns the pipeline, runs commands in order and reports
+// the playback position every 250 ms while playing.
+static gpointer controller_thread(gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    gint64 last_position = 0;
+    gboolean running = TRUE;
+    
+    // GStreamer initializes here, in parallel with widget creation, unless
+    // main() already did so for --gst-* options.
+    gst_init(NULL, NULL);
+    startup_trace("gstreamer initialized");
+    // With a file from the command line the open itself loads the plugins.
+    if (g_async_queue_length(app->commands) == 0)
+        controller_prewarm();
+    
+    while (running) {
+        PlayerCommand *cmd = g_async_queue_timeout_pop(app->commands, 250 * G_TIME_SPAN_MILLISECOND);
+        if (cmd) {
+            running = controller_handle(app, cmd);
+            player_command_free(cmd);
+        }
+        
+        gint64 now = g_get_monotonic_time();
+        if (running && now - last_position >= 250 * G_TIME_SPAN_MILLISECOND) {
+            controller_post_position(app);
+            last_position = now;
+        }
+    }
+    
+    controller_teardown(app);
+    return NULL;
+}
+
+// Drop the calling thread to the lowest CPU priority. On Linux the
+// nice value is per thread, so this leaves playback threads untouched.
+static void lower_thread_priority(void) {
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19) != 0)
+        g_printerr("Failed to lower preview thread priority\n");
+}
+
+// Look up a cached preview for a position. Falls back to the nearest
+// sprite sheet frame; *exact tells whether the frame is for this second.
+static GdkPixbuf *preview_lookup(VynPlayerApp *app, gint64 position, gboolean *exact) {
+    PreviewCache *cache = &app->preview;
+    gint64 bucket = position / GST_SECOND;
+    GdkPixbuf *pixbuf = NULL;
+    
+    g_mutex_lock(&cache->lock);
+    GList *link = g_hash_table_lookup(cache->frames, &bucket);
+    if (link) {
+        // Move to the front of the LRU queue.
+        g_queue_unlink(&cache->lru, link);
+        g_queue_push_head_link(&cache->lru, link);
+        pixbuf = g_object_ref(((PreviewFrame *)link->data)->pixbuf);
+        *exact = TRUE;
+    } else {
+        *exact = FALSE;
+        if (cache->sprites_duration > 0) {
+            gint index = (gint)(position * PREVIEW_SPRITE_FRAMES / cache->sprites_duration);
+            index = CLAMP(index, 0, PREVIEW_SPRITE_FRAMES - 1);
+            if (cache->sprites[index])
+                pixbuf = g_object_ref(cache->sprites[index]);
+        }
+    }
+    g_mutex_unlock(&cache->lock);
+    return pixbuf;
+}
+
+// Ask the worker to decode a frame. Replaces any request not yet started.
+static void preview_request(VynPlayerApp *app, gint64 position) {
+    PreviewCache *cache = &app->preview;
+    g_mutex_lock(&cache->lock);
+    cache->request_bucket = position / GST_SECOND;
+    cache->has_request = TRUE;
+    g_cond_signal(&cache->cond);
+    g_mutex_unlock(&cache->lock);
+}
+
+static void preview_frame_free(PreviewFrame *frame) {
+    g_object_unref(frame->pixbuf);
+    g_free(frame);
+}
+
+// Drop all cached frames and sprites. Call with the lock held.
+static void preview_clear_locked(PreviewCache *cache) {
+    g_hash_table_remove_all(cache->frames);
+    g_queue_foreach(&cache->lru, (GFunc)preview_frame_free, NULL);
+    g_queue_clear(&cache->lru);
+    for (gint i = 0; i < PREVIEW_SPRITE_FRAMES; i++)
+        g_clear_object(&cache->sprites[i]);
+    cache->sprites_done = 0;
+    cache->sprites_duration = 0;
+}
+
+// Insert a decoded frame, evicting the least recently used one. Call with the lock held.
+static void preview_insert_locked(PreviewCache *cache, gint64 bucket, GdkPixbuf *pixbuf) {
+    if (g_hash_table_contains(cache->frames, &bucket))
+        return;
+    if (cache->lru.length >= PREVIEW_CACHE_SIZE) {
+        PreviewFrame *oldest = g_queue_pop_tail(&cache->lru);
+        g_hash_table_remove(cache->frames, &oldest->bucket);
+        preview_frame_free(oldest);
+    }
+    PreviewFrame *frame = g_new0(PreviewFrame, 1);
+    frame->bucket = bucket;
+    frame->pixbuf = g_object_ref(pixbuf);
+    g_queue_push_head(&cache->lru, frame);
+    g_hash_table_insert(cache->frames, &frame->bucket, cache->lru.head);
+}
+
+// Point the preview worker at a new file.
+static void preview_set_file(VynPlayerApp *app, const gchar *path) {
+    PreviewCache *cache = &app->preview;
+    g_mutex_lock(&cache->lock);
+    g_free(cache->path);
+    cache->path = g_strdup(path);
+    cache->path_serial++;
+    cache->has_request = FALSE;
+    preview_clear_locked(cache);
+    g_cond_signal(&cache->cond);
+    g_mutex_unlock(&cache->lock);
+}
+
+// Sprite sheets are cached per file, keyed by path, size and mtime.
+static gchar *preview_sprite_path(const gchar *path) {
+    GStatBuf st;
+    if (g_stat(path, &st) != 0)
+        return NULL;
+    gchar *key = g_strdup_printf("%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                                 path, (gint64)st.st_size, (gint64)st.st_mtime);
+    gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    gchar *name = g_strdup_printf("%s.png", hash);
+    gchar *sprite_path = g_build_filename(g_get_user_cache_dir(), "vynplayer", "previews", name, NULL);
+    g_free(name);
+    g_free(hash);
+    g_free(key);
+    return sprite_path;
+}
+
+// Load a previously generated sprite sheet into the cache. Worker thread only.
+static void preview_load_sprites(PreviewCache *cache, const gchar *path, guint serial) {
+    gchar *sprite_path = preview_sprite_path(path);
+    if (!sprite_path)
+        return;
+    GdkPixbuf *sheet = gdk_pixbuf_new_from_file(sprite_path, NULL);
+    g_free(sprite_path);
+    if (!sheet)
+        return;
+    
+    gint rows = PREVIEW_SPRITE_FRAMES / PREVIEW_SPRITE_COLUMNS;
+    gint width = gdk_pixbuf_get_width(sheet) / PREVIEW_SPRITE_COLUMNS;
+    gint height = gdk_pixbuf_get_height(sheet) / rows;
+    
+    g_mutex_lock(&cache->lock);
+    if (serial == cache->path_serial && width > 0 && height > 0) {
+        for (gint i = 0; i < PREVIEW_SPRITE_FRAMES; i++)
+            cache->sprites[i] = gdk_pixbuf_new_subpixbuf(sheet,
+                                                         (i % PREVIEW_SPRITE_COLUMNS) * width,
+                                                         (i / PREVIEW_SPRITE_COLUMNS) * height,
+                                                         width, height);
+        cache->sprites_done = PREVIEW_SPRITE_FRAMES;
+        cache->sprites_duration = cache->duration;
+    }
+    g_mutex_unlock(&cache->lock);
+    g_object_unref(sheet);
+}
+
+// Tile frames into a sheet, row by row. The first frame sets the tile size;
+// missing frames and frames of another size are left black.
+static GdkPixbuf *compose_sheet(GdkPixbuf **frames, gint count, gint columns) {
+    gint width = gdk_pixbuf_get_width(frames[0]);
+    gint height = gdk_pixbuf_get_height(frames[0]);
+    gint rows = (count + columns - 1) / columns;
+    
+    GdkPixbuf *sheet = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width * columns, height * rows);
+    gdk_pixbuf_fill(sheet, 0x000000ff);
+    for (gint i = 0; i < count; i++) {
+        if (!frames[i] || gdk_pixbuf_get_width(frames[i]) != width ||
+            gdk_pixbuf_get_height(frames[i]) != height)
+            continue;
+        gdk_pixbuf_copy_area(frames[i], 0, 0, width, height, sheet,
+                             (i % columns) * width, (i / columns) * height);
+    }
+    return sheet;
+}
+
+// Write the finished sprite frames to disk as a single sheet. Worker thread only.
+static void preview_save_sprites(GdkPixbuf **sprites, const gchar *path) {
+    gchar *sprite_path = preview_sprite_path(path);
+    if (!sprite_path)
+        return;
+    
+    GdkPixbuf *sheet = compose_sheet(sprites, PREVIEW_SPRITE_FRAMES, PREVIEW_SPRITE_COLUMNS);
+    gchar *dir = g_path_get_dirname(sprite_path);
+    GError *error = NULL;
+    if (g_mkdir_with_parents(dir, 0700) != 0 ||
+        !gdk_pixbuf_save(sheet, sprite_path, "png", &error, NULL)) {
+        g_printerr("Failed to save preview sprites: %s\n", error ? error->message : dir);
+        g_clear_error(&error);
+    }
+    g_free(dir);
+    g_free(sprite_path);
+    g_object_unref(sheet);
+}
+
+// Task pool for the preview pipeline. GStreamer's default pool shares its
+// threads with every other pipeline, including playback, and a thread cannot
+// raise its priority again once lowered. Each preview task instead gets a
+// thread of its own, run at the lowest priority, which exits with the task.
+typedef struct {
+    GstTaskPool parent;
+} PreviewTaskPool;
+
+typedef GstTaskPoolClass PreviewTaskPoolClass;
+
+G_DEFINE_TYPE(PreviewTaskPool, preview_task_pool, GST_TYPE_TASK_POOL)
+
+typedef struct {
+    GstTaskPoolFunction func;
+    gpointer user_data;
+} PreviewTask;
+
+static gpointer preview_task_run(gpointer data) {
+    PreviewTask *task = (PreviewTask *)data;
+    lower_thread_priority();
+    task->func(task->user_data);
+    g_free(task);
+    return NULL;
+}
+
+static void preview_task_pool_prepare(GstTaskPool *pool, GError **error) {
+    (void)pool;
+    (void)error;
+}
+
+static void preview_task_pool_cleanup(GstTaskPool *pool) {
+    (void)pool;
+}
+
+static gpointer preview_task_pool_push(GstTaskPool *pool, GstTaskPoolFunction func,
+                                       gpointer user_data, GError **error) {
+    (void)pool;
+    PreviewTask *task = g_new(PreviewTask, 1);
+    task->func = func;
+    task->user_data = user_data;
+    GThread *thread = g_thread_try_new("preview-stream", preview_task_run, task, error);
+    if (!thread)
+        g_free(task);
+    return thread;
+}
+
+static void preview_task_pool_join(GstTaskPool *pool, gpointer id) {
+    (void)pool;
+    if (id)
+        g_thread_join((GThread *)id);
+}
+
+static void preview_task_pool_class_init(PreviewTaskPoolClass *klass) {
+    klass->prepare = preview_task_pool_prepare;
+    klass->cleanup = preview_task_pool_cleanup;
+    klass->push = preview_task_pool_push;
+    klass->join = preview_task_pool_join;
+}
+
+static void preview_task_pool_init(PreviewTaskPool *pool) {
+    (void)pool;
+}
+
+// Move the preview pipeline's streaming tasks onto its own task pool as they
+// are created, so decoding previews never competes with playback.
+static GstBusSyncReply preview_bus_sync(GstBus *bus, GstMessage *msg, gpointer data) {
+    (void)bus;
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_STREAM_STATUS) {
+        GstStreamStatusType type;
+        GstElement *owner;
+        gst_message_parse_stream_status(msg, &type, &owner);
+        const GValue *object = gst_message_get_stream_status_object(msg);
+        if (data && type == GST_STREAM_STATUS_TYPE_CREATE && object && G_VALUE_HOLDS_OBJECT(object) &&
+            GST_IS_TASK(g_value_get_object(object)))
+            gst_task_set_pool(GST_TASK(g_value_get_object(object)), (GstTaskPool *)data);
+    }
+    return GST_BUS_DROP;
+}
+
+static void preview_close(PreviewCache *cache) {
+    if (!cache->pipeline)
+        return;
+    gst_element_set_state(cache->pipeline, GST_STATE_NULL);
+    gst_object_unref(cache->sink);
+    gst_object_unref(cache->pipeline);
+    cache->pipeline = NULL;
+    cache->sink = NULL;
+    cache->duration = 0;
+}
+
+// Build a paused, reduced resolution decode pipeline for the file. Worker thread only.
+static gboolean preview_open(PreviewCache *cache, const gchar *path) {
+    preview_close(cache);
+    if (!path)
+        return FALSE;
+    
+    gchar *pipeline_str = g_strdup_printf(
+        "filesrc name=src ! qtdemux ! h264parse ! avdec_h264 max-threads=1 ! "
+        "videoconvert ! videoscale ! video/x-raw,format=RGB,width=%d,pixel-aspect-ratio=1/1 ! "
+        "appsink name=previewsink sync=false max-buffers=1 drop=true enable-last-sample=false",
+        PREVIEW_WIDTH);
+    cache->pipeline = gst_parse_launch(pipeline_str, NULL);
+    g_free(pipeline_str);
+    if (!cache->pipeline)
+        return FALSE;
+    set_element_location(cache->pipeline, "src", path);
+    
+    GstBus *bus = gst_element_get_bus(cache->pipeline);
+    gst_bus_set_sync_handler(bus, preview_bus_sync, cache->task_pool, NULL);
+    gst_object_unref(bus);
+    cache->sink = gst_bin_get_by_name(GST_BIN(cache->pipeline), "previewsink");
+    
+    gst_element_set_state(cache->pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(cache->pipeline, NULL, NULL, 5 * GST_SECOND) == GST_STATE_CHANGE_FAILURE ||
+        !gst_element_query_duration(cache->pipeline, GST_FORMAT_TIME, &cache->duration)) {
+        g_printerr("Failed to open preview pipeline for %s\n", path);
+        preview_close(cache);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Copy a decoded RGB sample into a pixbuf.
+static GdkPixbuf *sample_to_pixbuf(GstSample *sample) {
+    GdkPixbuf *pixbuf = NULL;
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstCaps *caps = gst_sample_get_caps(sample);
+    GstVideoInfo info;
+    GstMapInfo map;
+    if (buffer && caps && gst_video_info_from_caps(&info, caps) &&
+        gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        gint stride = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+        gint height = GST_VIDEO_INFO_HEIGHT(&info);
+        GBytes *bytes = g_bytes_new(map.data, MIN(map.size, (gsize)stride * height));
+        pixbuf = gdk_pixbuf_new_from_bytes(bytes, GDK_COLORSPACE_RGB, FALSE, 8,
+                                           GST_VIDEO_INFO_WIDTH(&info), height, stride);
+        g_bytes_unref(bytes);
+        gst_buffer_unmap(buffer, &map);
+    }
+    return pixbuf;
+}
+
+// Seek a paused pipeline ending in an RGB appsink and return the frame it
+// prerolls on.
+static GdkPixbuf *decode_frame_at(GstElement *pipeline, GstElement *sink, gint64 position,
+                                  gint64 duration, GstSeekFlags flags) {
+    if (!gst_element_seek_simple(pipeline, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | flags,
+                                 CLAMP(position, 0, duration)))
+        return NULL;
+    
+    GstSample *sample = gst_app_sink_try_pull_preroll(GST_APP_SINK(sink), 2 * GST_SECOND);
+    if (!sample)
+        return NULL;
+    GdkPixbuf *pixbuf = sample_to_pixbuf(sample);
+    gst_sample_unref(sample);
+    return pixbuf;
+}
+
+// Decode the keyframe at or before a position into a pixbuf. Worker thread only.
+static GdkPixbuf *preview_decode(PreviewCache *cache, gint64 position) {
+    if (!cache->pipeline)
+        return NULL;
+    return decode_frame_at(cache->pipeline, cache->sink, position, cache->duration,
+                           GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE);
+}
+
+static gboolean preview_ready_idle(gpointer data);
+
+// Preview worker: decodes hover requests first, and fills the sprite sheet
+// with evenly spaced frames while idle if sprites are enabled.
+static gpointer preview_thread(gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    PreviewCache *cache = &app->preview;
+    guint serial = 0;
+    
+    lower_thread_priority();
+    gst_init(NULL, NULL);
+    cache->task_pool = gst_object_ref_sink(g_object_new(preview_task_pool_get_type(), NULL));
+    gst_task_pool_prepare(cache->task_pool, NULL);
+    
+    g_mutex_lock(&cache->lock);
+    while (!cache->quit) {
+        if (serial != cache->path_serial) {
+            gchar *path = g_strdup(cache->path);
+            serial = cache->path_serial;
+            g_mutex_unlock(&cache->lock);
+            if (preview_open(cache, path) && cache->sprites_enabled)
+                preview_load_sprites(cache, path, serial);
+            g_free(path);
+            g_mutex_lock(&cache->lock);
+            continue;
+        }
+        
+        if (cache->has_request) {
+            gint64 bucket = cache->request_bucket;
+            cache->has_request = FALSE;
+            if (g_hash_table_contains(cache->frames, &bucket))
+                continue;
+            g_mutex_unlock(&cache->lock);
+            GdkPixbuf *pixbuf = preview_decode(cache, bucket * GST_SECOND);
+            g_mutex_lock(&cache->lock);
+            if (pixbuf) {
+                if (serial == cache->path_serial) {
+                    preview_insert_locked(cache, bucket, pixbuf);
+                    g_idle_add(preview_ready_idle, app);
+                }
+                g_object_unref(pixbuf);
+            }
+            continue;
+        }
+        
+        if (cache->sprites_enabled && cache->pipeline && cache->sprites_done < PREVIEW_SPRITE_FRAMES) {
+            gint index = cache->sprites_done;
+            g_mutex_unlock(&cache->lock);
+            gint64 position = (2 * index + 1) * cache->duration / (2 * PREVIEW_SPRITE_FRAMES);
+            GdkPixbuf *pixbuf = preview_decode(cache, position);
+            g_mutex_lock(&cache->lock);
+            if (serial != cache->path_serial) {
+                if (pixbuf)
+                    g_object_unref(pixbuf);
+                continue;
+            }
+            cache->sprites[index] = pixbuf;
+            cache->sprites_done++;
+            if (index == 0)
+                cache->sprites_duration = cache->duration;
+            if (cache->sprites_done == PREVIEW_SPRITE_FRAMES) {
+                gboolean complete = TRUE;
+                GdkPixbuf *sprites[PREVIEW_SPRITE_FRAMES];
+                for (gint i = 0; i < PREVIEW_SPRITE_FRAMES; i++) {
+                    complete = complete && cache->sprites[i] != NULL;
+                    sprites[i] = cache->sprites[i] ? g_object_ref(cache->sprites[i]) : NULL;
+                }
+                gchar *path = g_strdup(cache->path);
+                g_mutex_unlock(&cache->lock);
+                if (complete)
+                    preview_save_sprites(sprites, path);
+                for (gint i = 0; i < PREVIEW_SPRITE_FRAMES; i++)
+                    if (sprites[i])
+                        g_object_unref(sprites[i]);
+                g_free(path);
+                g_mutex_lock(&cache->lock);
+            }
+            continue;
+        }
+        
+        g_cond_wait(&cache->cond, &cache->lock);
+    }
+    g_mutex_unlock(&cache->lock);
+    
+    preview_close(cache);
+    gst_task_pool_cleanup(cache->task_pool);
+    gst_object_unref(cache->task_pool);
+    cache->task_pool = NULL;
+    return NULL;
+}
+
+// Show the preview for the hovered position in the popup.
+static void preview_show(VynPlayerApp *app) {
+    gboolean exact;
+    GdkPixbuf *pixbuf = preview_lookup(app, app->preview_position, &exact);
+    if (!exact)
+        preview_request(app, app->preview_position);
+    if (pixbuf) {
+        gtk_image_set_from_pixbuf(GTK_IMAGE(app->preview_image), pixbuf);
+        g_object_unref(pixbuf);
+    }
+    
+    gint64 position = app->preview_position;
+    gchar *time_str = g_strdup_printf("%02d:%02d:%02d",
+                                      (gint)(position / (3600 * GST_SECOND)),
+                                      (gint)((position / (60 * GST_SECOND)) % 60),
+                                      (gint)((position / GST_SECOND) % 60));
+    gtk_label_set_text(GTK_LABEL(app->preview_label), time_str);
+    g_free(time_str);
+}
+
+// A requested frame finished decoding; refresh the popup if it is still up.
+static gboolean preview_ready_idle(gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    if (gtk_widget_get_visible(app->preview_window))
+        preview_show(app);
+    return G_SOURCE_REMOVE;
+}
+
+// Progress bar hover handler for previews.
+static gboolean progress_bar_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    if (app->duration <= 0)
+        return FALSE;
+    
+    GtkAllocation allocation;
+    gtk_widget_get_allocation(widget, &allocation);
+    gdouble pos = CLAMP(event->x / allocation.width, 0.0, 1.0);
+    app->preview_position = (gint64)(pos * app->duration);
+    preview_show(app);
+    
+    // Place the popup centered above the pointer.
+    gint width, height;
+    gtk_widget_show_all(app->preview_window);
+    gtk_window_get_size(GTK_WINDOW(app->preview_window), &width, &height);
+    gtk_window_move(GTK_WINDOW(app->preview_window),
+                    (gint)event->x_root - width / 2,
+                    (gint)(event->y_root - event->y) - height - 4);
+    return FALSE;
+}
+
+static gboolean progress_bar_leave(GtkWidget *widget, GdkEventCrossing *event, gpointer data) {
+    VynPlayerApp *app = (VynPlayerApp *)data;
+    (void)widget;
+    (void)event;
+    gtk_widget_hide(app->preview_window);
+    return FALSE;
+}
+
+// Stop the preview worker and free the cache.
+static void preview_shutdown(VynPlayerApp *app) {
+    PreviewCache *cache = &app->preview;
+    if (!cache->thread)
+        return;
+    
+    g_mutex_lock(&cache->lock);
+    cache->quit = TRUE;
+    g_cond_signal(&cache->cond);
+    g_mutex_unlock(&cache->lock);
+    g_thread_join(cache->thread);
+    cache->thread = NULL;
+    
+    preview_clear_locked(cache);
+    g_hash_table_destroy(cache->frames);
+    g_free(cache->path);
+    g_mutex_clear(&cache->lock);
+    g_cond_clear(&cache->cond);
+}
+
+// Clean up GStreamer resources.
+static void cleanup_gstreamer(VynPlayerApp *app) {
+    preview_shutdown(app);
+    if (app->controller) {
+        player_send(app, player_command_new(app, PLAYER_CMD_QUIT));
+        g_thread_join(app->controller);
+        app->controller = NULL;
+    }
+    if (app->commands) {
+        PlayerCommand *cmd;
+        while ((cmd = g_async_queue_try_pop(app->commands)))
+            player_command_free(cmd);
+        g_async_queue_unref(app->commands);
+        app->commands = NULL;
+    }
+    if (app->video_list) {
+        g_list_free_full(app->video_list, g_free);
+        app->video_list = NULL;
+        app->current_video = NULL;
+    }
+}
+
+// Count decoded frames reaching the sink during --bench-decode.
+static GstPadProbeReturn bench_frame_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    (void)pad;
+    (void)info;
+    g_atomic_int_inc((gint *)data);
+    return GST_PAD_PROBE_OK;
+}
+
+// Headless decode benchmark: decode the whole video track through the
+// playback chain as fast as possible, then fetch hover previews across the
+// file the way the preview worker does.
+static int run_decode_bench(const gchar *path) {
+    gst_init(NULL, NULL);
+    
+    gchar *pipeline_str = decode_pipeline_description(path, "videoconvert ! fakesink name=sink sync=false", NULL);
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+    g_free(pipeline_str);
+    if (!pipeline) {
+        g_printerr("Failed to create pipeline: %s\n", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        return 1;
+    }
+    g_clear_error(&error);
+    decode_pipeline_set_location(pipeline, path);
+    
+    gint frames = 0;
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, bench_frame_probe, &frames, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(sink);
+    
+    gint64 start = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    gint64 decode_time = g_get_monotonic_time() - start;
+    gboolean failed = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR;
+    if (failed) {
+        gst_message_parse_error(msg, &error, NULL);
+        g_printerr("Decode failed: %s\n", error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    if (failed)
+        return 1;
+    g_print("decode:  %d frames in %.2f s, %.1f frames/s\n",
+            frames, decode_time / (gdouble)G_USEC_PER_SEC, frames * (gdouble)G_USEC_PER_SEC / decode_time);
+    
+    PreviewCache cache = {0};
+    if (!preview_open(&cache, path))
+        return 1;
+    gint previews = 0;
+    start = g_get_monotonic_time();
+    for (gint i = 0; i < PREVIEW_SPRITE_FRAMES; i++) {
+        GdkPixbuf *pixbuf = preview_decode(&cache, (2 * i + 1) * cache.duration / (2 * PREVIEW_SPRITE_FRAMES));
+        if (pixbuf) {
+            previews++;
+            g_object_unref(pixbuf);
+        }
+    }
+    gint64 preview_time = g_get_monotonic_time() - start;
+    preview_close(&cache);
+    g_print("preview: %d frames, %.2f ms per frame\n",
+            previews, previews ? preview_time / 1000.0 / previews : 0.0);
+    return previews > 0 ? 0 : 1;
+}
+
+// Cap the threads a decoder or encoder starts, so concurrent batch
+// pipelines share the cores instead of each sizing itself to all of them.
+static void batch_limit_threads(const GValue *item, gpointer data) {
+    GObject *element = g_value_get_object(item);
+    guint threads = GPOINTER_TO_UINT(data);
+    const gchar *names[] = { "max-threads", "threads" };
+    
+    for (guint i = 0; i < G_N_ELEMENTS(names); i++) {
+        GParamSpec *pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), names[i]);
+        if (!pspec)
+            continue;
+        if (G_PARAM_SPEC_VALUE_TYPE(pspec) == G_TYPE_UINT)
+            g_object_set(element, names[i], threads, NULL);
+        else if (G_PARAM_SPEC_VALUE_TYPE(pspec) == G_TYPE_INT)
+            g_object_set(element, names[i], (gint)threads, NULL);
+    }
+}
+
+// Build a batch pipeline on the player's decode chain, with extra elements
+// appended to the description.
+static GstElement *batch_pipeline_new(BatchConfig *config, const gchar *path, const gchar *video_tail,
+                                      const gchar *audio_tail, const gchar *extra) {
+    gchar *decode = decode_pipeline_description(path, video_tail, audio_tail);
+    gchar *pipeline_str = g_strconcat(decode, extra ? " " : "", extra ? extra : "", NULL);
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(pipeline_str, &error);
+    g_free(pipeline_str);
+    g_free(decode);
+    if (!pipeline) {
+        g_printerr("%s: %s\n", path, error ? error->message : "could not create pipeline");
+        g_clear_error(&error);
+        return NULL;
+    }
+    g_clear_error(&error);
+    decode_pipeline_set_location(pipeline, path);
+    
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    gst_iterator_foreach(it, batch_limit_threads, GUINT_TO_POINTER(config->threads));
+    gst_iterator_free(it);
+    return pipeline;
+}
+
+// Print a pipeline error for the file, if one was posted.
+static gboolean batch_check_error(GstElement *pipeline, const gchar *path, GstClockTime timeout) {
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, timeout, GST_MESSAGE_ERROR);
+    gst_object_unref(bus);
+    if (!msg)
+        return TRUE;
+    
+    GError *error = NULL;
+    gst_message_parse_error(msg, &error, NULL);
+    g_printerr("%s: %s\n", path, error->message);
+    g_clear_error(&error);
+    gst_message_unref(msg);
+    return FALSE;
+}
+
+// Run a pipeline to the end of the file.
+static gboolean batch_run_to_eos(GstElement *pipeline, const gchar *path) {
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        batch_check_error(pipeline, path, 0);
+        return FALSE;
+    }
+    
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (!ok) {
+        GError *error = NULL;
+        gst_message_parse_error(msg, &error, NULL);
+        g_printerr("%s: %s\n", path, error->message);
+        g_clear_error(&error);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    return ok;
+}
+
+// Preroll a pipeline and return its duration, or -1 if it cannot play.
+static gint64 batch_preroll(GstElement *pipeline, const gchar *path) {
+    gint64 duration;
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND) != GST_STATE_CHANGE_SUCCESS ||
+        !gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration) || duration <= 0) {
+        if (batch_check_error(pipeline, path, 0))
+            g_printerr("%s: could not preroll\n", path);
+        return -1;
+    }
+    return duration;
+}
+
+static gboolean batch_save_frame(GdkPixbuf *pixbuf, const gchar *dir, gint64 position) {
+    gint64 ms = position / GST_MSECOND;
+    gchar *name = g_strdup_printf("%02d-%02d-%02d.%03d.jpg", (gint)(ms / 3600000), (gint)(ms / 60000 % 60),
+                                  (gint)(ms / 1000 % 60), (gint)(ms % 1000));
+    gchar *path = g_build_filename(dir, name, NULL);
+    GError *error = NULL;
+    gboolean ok = gdk_pixbuf_save(pixbuf, path, "jpeg", &error, "quality", "90", NULL);
+    if (!ok) {
+        g_printerr("%s: %s\n", path, error->message);
+        g_clear_error(&error);
+    }
+    g_free(path);
+    g_free(name);
+    return ok;
+}
+
+// Extract a full size frame every interval, seeking from frame to frame.
+static gboolean batch_extract_interval(BatchConfig *config, BatchJob *job, const gchar *dir) {
+    GstElement *pipeline = batch_pipeline_new(config, job->path,
+        "videoconvert ! video/x-raw,format=RGB ! "
+        "appsink name=sink sync=false max-buffers=1 enable-last-sample=false", NULL, NULL);
+    if (!pipeline)
+        return FALSE;
+    
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gint64 duration = batch_preroll(pipeline, job->path);
+    gint64 step = (gint64)(config->interval * GST_SECOND);
+    gboolean ok = duration > 0;
+    for (gint64 position = 0; ok && position < duration; position += step) {
+        GdkPixbuf *pixbuf = decode_frame_at(pipeline, sink, position, duration, GST_SEEK_FLAG_ACCURATE);
+        if (!pixbuf)
+            continue;
+        ok = batch_save_frame(pixbuf, dir, position);
+        g_object_unref(pixbuf);
+    }
+    ok = ok && batch_check_error(pipeline, job->path, 0);
+    
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+// Sample the frame's luma on a coarse grid.
+static void batch_scene_grid(GdkPixbuf *pixbuf, guint8 *grid) {
+    gint width = gdk_pixbuf_get_width(pixbuf);
+    gint height = gdk_pixbuf_get_height(pixbuf);
+    gint stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8 *pixels = gdk_pixbuf_read_pixels(pixbuf);
+    
+    for (gint gy = 0; gy < BATCH_SCENE_GRID_HEIGHT; gy++) {
+        const guint8 *row = pixels + (gsize)((2 * gy + 1) * height / (2 * BATCH_SCENE_GRID_HEIGHT)) * stride;
+        for (gint gx = 0; gx < BATCH_SCENE_GRID_WIDTH; gx++) {
+            const guint8 *p = row + (2 * gx + 1) * width / (2 * BATCH_SCENE_GRID_WIDTH) * 3;
+            grid[gy * BATCH_SCENE_GRID_WIDTH + gx] = (2 * p[0] + 5 * p[1] + p[2]) / 8;
+        }
+    }
+}
+
+// Decode the whole file at a reduced frame rate and extract the first frame
+// of every scene: a frame whose sampled luma differs from the previous
+// sample by more than the threshold, on average.
+static gboolean batch_extract_scenes(BatchConfig *config, BatchJob *job, const gchar *dir) {
+    gchar *video_tail = g_strdup_printf(
+        "videorate drop-only=true max-rate=%d ! videoconvert ! video/x-raw,format=RGB ! "
+        "appsink name=sink sync=false max-buffers=2 enable-last-sample=false", BATCH_SCENE_FPS);
+    GstElement *pipeline = batch_pipeline_new(config, job->path, video_tail, NULL, NULL);
+    g_free(video_tail);
+    if (!pipeline)
+        return FALSE;
+    
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    guint8 grid[2][BATCH_SCENE_GRID_WIDTH * BATCH_SCENE_GRID_HEIGHT];
+    gint current = 0;
+    gboolean first = TRUE;
+    gboolean ok = gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+    while (ok) {
+        GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), GST_SECOND);
+        if (!sample) {
+            // Slow decodes time out here; errors never reach the sink.
+            if (gst_app_sink_is_eos(GST_APP_SINK(sink)))
+                break;
+            ok = batch_check_error(pipeline, job->path, 0);
+            continue;
+        }
+        
+        GdkPixbuf *pixbuf = sample_to_pixbuf(sample);
+        if (pixbuf) {
+            guint diff = 0;
+            batch_scene_grid(pixbuf, grid[current]);
+            for (gint i = 0; !first && i < BATCH_SCENE_GRID_WIDTH * BATCH_SCENE_GRID_HEIGHT; i++)
+                diff += ABS(grid[current][i] - grid[!current][i]);
+            if (first || diff > config->scene_threshold * 255 * BATCH_SCENE_GRID_WIDTH * BATCH_SCENE_GRID_HEIGHT) {
+                GstBuffer *buffer = gst_sample_get_buffer(sample);
+                gint64 position = gst_segment_to_stream_time(gst_sample_get_segment(sample), GST_FORMAT_TIME,
+                                                             GST_BUFFER_PTS(buffer));
+                ok = batch_save_frame(pixbuf, dir, MAX(position, 0));
+            }
+            current = !current;
+            first = FALSE;
+            g_object_unref(pixbuf);
+        }
+        gst_sample_unref(sample);
+    }
+    ok = ok && batch_check_error(pipeline, job->path, 0);
+    
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+// Tile evenly spaced keyframes into a contact sheet, as the hover preview
+// sprites are built.
+static gboolean batch_contact_sheet(BatchConfig *config, BatchJob *job, const gchar *output) {
+    gchar *video_tail = g_strdup_printf(
+        "videoconvert ! videoscale ! video/x-raw,format=RGB,width=%d,pixel-aspect-ratio=1/1 ! "
+        "appsink name=sink sync=false max-buffers=1 enable-last-sample=false", config->sheet_width);
+    GstElement *pipeline = batch_pipeline_new(config, job->path, video_tail, NULL, NULL);
+    g_free(video_tail);
+    if (!pipeline)
+        return FALSE;
+    
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GdkPixbuf **frames = g_new0(GdkPixbuf *, config->sheet_frames);
+    gint64 duration = batch_preroll(pipeline, job->path);
+    for (gint i = 0; duration > 0 && i < config->sheet_frames; i++)
+        frames[i] = decode_frame_at(pipeline, sink, (2 * i + 1) * duration / (2 * config->sheet_frames),
+                                    duration, GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    
+    gboolean ok = frames[0] != NULL;
+    if (ok) {
+        GdkPixbuf *sheet = compose_sheet(frames, config->sheet_frames, config->sheet_columns);
+        GError *error = NULL;
+        ok = gdk_pixbuf_save(sheet, output, "jpeg", &error, "quality", "85", NULL);
+        if (!ok) {
+            g_printerr("%s: %s\n", output, error->message);
+            g_clear_error(&error);
+        }
+        g_object_unref(sheet);
+    } else if (duration > 0) {
+        g_printerr("%s: no frames decoded\n", job->path);
+    }
+    for (gint i = 0; i < config->sheet_frames; i++)
+        if (frames[i])
+            g_object_unref(frames[i]);
+    g_free(frames);
+    return ok;
+}
+
+// Whether the demuxer exposes an audio track. The muxer would wait forever
+// on an audio branch that never gets linked.
+static gboolean batch_has_audio(BatchConfig *config, BatchJob *job) {
+    GstElement *pipeline = batch_pipeline_new(config, job->path, "fakesink", "fakesink async=false", NULL);
+    if (!pipeline)
+        return FALSE;
+    
+    gboolean has_audio = FALSE;
+    if (batch_preroll(pipeline, job->path) > 0) {
+        GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), "audioqueue");
+        GstPad *pad = gst_element_get_static_pad(queue, "sink");
+        has_audio = gst_pad_is_linked(pad);
+        gst_object_unref(pad);
+        gst_object_unref(queue);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return has_audio;
+}
+
+// Re-encode the file to the target profile.
+static gboolean batch_transcode(BatchConfig *config, BatchJob *job, const gchar *output) {
+    const TranscodeProfile *profile = config->profile;
+    gboolean has_audio = batch_has_audio(config, job);
+    gchar *video_tail = g_strdup_printf("videoconvert ! %s ! queue ! mux.", profile->video);
+    gchar *audio_tail = has_audio ? g_strdup_printf("%s ! queue ! mux.", profile->audio) : NULL;
+    gchar *mux = g_strdup_printf("%s name=mux ! filesink name=output", profile->muxer);
+    GstElement *pipeline = batch_pipeline_new(config, job->path, video_tail, audio_tail, mux);
+    g_free(mux);
+    g_free(audio_tail);
+    g_free(video_tail);
+    if (!pipeline)
+        return FALSE;
+    set_element_location(pipeline, "output", output);
+    
+    gboolean ok = batch_run_to_eos(pipeline, job->path);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+// Remove a directory of extracted frames.
+static void batch_remove_dir(const gchar *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar *entry;
+        while ((entry = g_dir_read_name(dir))) {
+            gchar *file = g_build_filename(path, entry, NULL);
+            g_unlink(file);
+            g_free(file);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+// Outputs are written next to their final name and renamed into place, so
+// an output that exists is complete. It is up to date unless its input
+// changed after it was written.
+static gboolean batch_up_to_date(const gchar *input, const gchar *output) {
+    GStatBuf in, out;
+    return g_stat(output, &out) == 0 && g_stat(input, &in) == 0 && out.st_mtime >= in.st_mtime;
+}
+
+// Thread pool worker: process one file.
+static void batch_run_job(gpointer data, gpointer user_data) {
+    BatchJob *job = (BatchJob *)data;
+    BatchConfig *config = (BatchConfig *)user_data;
+    gint64 start = g_get_monotonic_time();
+    const gchar *extension = config->mode == BATCH_SHEET ? "jpg" :
+                             config->mode == BATCH_TRANSCODE ? config->profile->extension : NULL;
+    gchar *base = g_build_filename(config->output_dir, job->relative, NULL);
+    gchar *output = extension ? g_strconcat(base, ".", extension, NULL) : g_strdup(base);
+    gchar *partial = g_strconcat(output, ".part", NULL);
+    gchar *parent = g_path_get_dirname(output);
+    gboolean skipped = FALSE;
+    gboolean ok = FALSE;
+    
+    if (!config->force && batch_up_to_date(job->path, output)) {
+        skipped = TRUE;
+    } else if (g_mkdir_with_parents(parent, 0755) != 0) {
+        g_printerr("Cannot create %s\n", parent);
+    } else {
+        if (config->mode == BATCH_FRAMES) {
+            batch_remove_dir(partial);
+            ok = g_mkdir(partial, 0755) == 0 &&
+                 (config->scene_threshold > 0 ? batch_extract_scenes(config, job, partial)
+                                              : batch_extract_interval(config, job, partial));
+            if (ok && g_file_test(output, G_FILE_TEST_IS_DIR))
+                batch_remove_dir(output);
+        } else if (config->mode == BATCH_SHEET) {
+            ok = batch_contact_sheet(config, job, partial);
+        } else {
+            ok = batch_transcode(config, job, partial);
+        }
+        
+        if (ok && g_rename(partial, output) != 0) {
+            g_printerr("Cannot rename %s to %s\n", partial, output);
+            ok = FALSE;
+        }
+        if (!ok) {
+            if (config->mode == BATCH_FRAMES)
+                batch_remove_dir(partial);
+            else
+                g_unlink(partial);
+        }
+    }
+    
+    g_mutex_lock(&config->lock);
+    if (skipped)
+        config->skipped++;
+    else if (ok)
+        config->done++;
+    else
+        config->failed++;
+    g_print("[%u/%u] %s: %s (%.1f s)\n", config->done + config->skipped + config->failed, config->total,
+            job->relative, skipped ? "up to date" : ok ? "done" : "failed",
+            (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC);
+    g_mutex_unlock(&config->lock);
+    
+    g_free(parent);
+    g_free(partial);
+    g_free(output);
+    g_free(base);
+}
+
+static void batch_job_free(BatchJob *job) {
+    g_free(job->path);
+    g_free(job->relative);
+    g_free(job);
+}
+
+// The batch only takes files the local playback chain decodes.
+static gboolean batch_is_input(const gchar *path) {
+    gchar *lower = g_ascii_strdown(path, -1);
+    gboolean input = g_str_has_suffix(lower, ".mp4") || g_str_has_suffix(lower, ".m4v") ||
+                     g_str_has_suffix(lower, ".mov");
+    g_free(lower);
+    return input;
+}
+
+static gint batch_compare_names(gconstpointer a, gconstpointer b) {
+    return g_strcmp0(*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+// Collect input files from a file or directory tree, skipping hidden
+// entries and the output directory. Symlinked directories inside the tree
+// are not followed, so a link back up it cannot loop.
+static void batch_collect(GPtrArray *jobs, const gchar *path, const gchar *relative, const gchar *output_dir) {
+    GStatBuf st;
+    if (relative && g_lstat(path, &st) == 0 && S_ISLNK(st.st_mode) &&
+        g_file_test(path, G_FILE_TEST_IS_DIR))
+        return;
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        gchar *canonical = g_canonicalize_filename(path, NULL);
+        gboolean is_output = g_str_equal(canonical, output_dir);
+        g_free(canonical);
+        GDir *dir = is_output ? NULL : g_dir_open(path, 0, NULL);
+        if (!dir)
+            return;
+        
+        GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+        const gchar *entry;
+        while ((entry = g_dir_read_name(dir)))
+            if (entry[0] != '.')
+                g_ptr_array_add(names, g_strdup(entry));
+        g_dir_close(dir);
+        g_ptr_array_sort(names, batch_compare_names);
+        for (guint i = 0; i < names->len; i++) {
+            const gchar *name = g_ptr_array_index(names, i);
+            gchar *child = g_build_filename(path, name, NULL);
+            gchar *child_relative = relative ? g_build_filename(relative, name, NULL) : g_strdup(name);
+            batch_collect(jobs, child, child_relative, output_dir);
+            g_free(child_relative);
+            g_free(child);
+        }
+        g_ptr_array_free(names, TRUE);
+        return;
+    }
+    
+    // Files named on the command line are taken whatever their extension.
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode) || (relative && !batch_is_input(path)))
+        return;
+    BatchJob *job = g_new0(BatchJob, 1);
+    job->path = g_strdup(path);
+    job->relative = relative ? g_strdup(relative) : g_path_get_basename(path);
+    job->size = st.st_size;
+    gchar *dot = strrchr(job->relative, '.');
+    gchar *slash = strrchr(job->relative, G_DIR_SEPARATOR);
+    if (dot && dot != job->relative && (!slash || dot > slash + 1))
+        *dot = '\0';
+    g_ptr_array_add(jobs, job);
+}
+
+// Largest first, so the longest jobs do not start last and leave the other
+// workers idle at the end of the run.
+static gint batch_compare_jobs(gconstpointer a, gconstpointer b) {
+    const BatchJob *job_a = *(BatchJob * const *)a;
+    const BatchJob *job_b = *(BatchJob * const *)b;
+    return (job_b->size > job_a->size) - (job_b->size < job_a->size);
+}
+
+// Memory that can be allocated without swapping, in MB.
+static gint64 available_memory_mb(void) {
+    gchar *meminfo = NULL;
+    gint64 available = 0;
+    if (g_file_get_contents("/proc/meminfo", &meminfo, NULL, NULL)) {
+        const gchar *line = strstr(meminfo, "MemAvailable:");
+        if (line)
+            available = g_ascii_strtoll(line + strlen("MemAvailable:"), NULL, 10) / 1024;
+        g_free(meminfo);
+    }
+    return available;
+}
+
+// Process every input under the given paths with a pool of concurrent
+// pipelines. Unless jobs is set, the pool gets one pipeline per core, fewer
+// if BATCH_JOB_MEMORY_MB each would exceed the memory budget, by default
+// half of the available memory.
+static int run_batch(BatchConfig *config, gint n_paths, gchar **paths, gint jobs, gint memory_budget_mb) {
+    gst_init(NULL, NULL);
+    
+    if (g_mkdir_with_parents(config->output_dir, 0755) != 0) {
+        g_printerr("Cannot create %s\n", config->output_dir);
+        return 1;
+    }
+    gchar *output_dir = g_canonicalize_filename(config->output_dir, NULL);
+    g_free(config->output_dir);
+    config->output_dir = output_dir;
+    
+    GPtrArray *inputs = g_ptr_array_new_with_free_func((GDestroyNotify)batch_job_free);
+    for (gint i = 0; i < n_paths; i++)
+        batch_collect(inputs, paths[i], NULL, config->output_dir);
+    if (inputs->len == 0) {
+        g_printerr("No MP4 or MOV files found\n");
+        g_ptr_array_free(inputs, TRUE);
+        return 1;
+    }
+    g_ptr_array_sort(inputs, batch_compare_jobs);
+    
+    gint cores = g_get_num_processors();
+    gint64 budget = memory_budget_mb > 0 ? memory_budget_mb : available_memory_mb() / 2;
+    if (jobs <= 0)
+        jobs = CLAMP(budget / BATCH_JOB_MEMORY_MB, 1, cores);
+    config->threads = MAX(1, cores / jobs);
+    config->total = inputs->len;
+    g_mutex_init(&config->lock);
+    g_print("Batch: %u files, %d pipelines with %u threads each (%d cores, %" G_GINT64_FORMAT " MB budget)\n",
+            inputs->len, jobs, config->threads, cores, budget);
+    
+    gint64 start = g_get_monotonic_time();
+    GError *error = NULL;
+    GThreadPool *pool = g_thread_pool_new(batch_run_job, config, jobs, TRUE, &error);
+    if (!pool) {
+        g_printerr("%s\n", error->message);
+        g_clear_error(&error);
+        g_ptr_array_free(inputs, TRUE);
+        return 1;
+    }
+    for (guint i = 0; i < inputs->len; i++)
+        g_thread_pool_push(pool, g_ptr_array_index(inputs, i), NULL);
+    g_thread_pool_free(pool, FALSE, TRUE);
+    
+    gdouble seconds = (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+    g_print("%u done, %u up to date, %u failed in %.1f s\n",
+            config->done, config->skipped, config->failed, seconds);
+    g_mutex_clear(&config->lock);
+    g_ptr_array_free(inputs, TRUE);
+    return config->failed > 0 ? 1 : 0;
+}
+
+// Trace time-to-window on the first frame of the main window.
+static gboolean window_first_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    (void)cr;
+    (void)data;
+    startup_trace("window drawn");
+    g_signal_handlers_disconnect_by_func(widget, G_CALLBACK(window_first_draw), NULL);
+    return FALSE;
+}
+
+// Main function.
+int main(int argc, char *argv[]) {
+    static gboolean preview_sprites = FALSE;
+    static gchar *cache_dir = NULL;
+    static gint cache_size_mb = 256;
+    static gint prefetch_seconds = 30;
+    static gint max_bitrate = 0;
+    static gchar *bench_decode = NULL;
+    static gchar *batch_mode = NULL;
+    static gchar *batch_output = NULL;
+    static gint batch_jobs = 0;
+    static gint batch_memory_mb = 0;
+    static gdouble batch_interval = 10.0;
+    static gdouble batch_scene = 0.0;
+    static gint sheet_frames = 20;
+    static gint sheet_columns = 5;
+    static gint sheet_width = 320;
+    static gchar *batch_profile = NULL;
+    static gboolean batch_force = FALSE;
+    static GOptionEntry entries[] = {
+        { "preview-sprites", 0, 0, G_OPTION_ARG_NONE, &preview_sprites,
+          "Pre-generate a preview sprite sheet for each opened file", NULL },
+        { "cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &cache_dir,
+          "Buffer network downloads on disk in DIR", "DIR" },
+        { "cache-size", 0, 0, G_OPTION_ARG_INT, &cache_size_mb,
+          "Size of the on-disk download buffer in MB (default 256)", "MB" },
+        { "prefetch", 0, 0, G_OPTION_ARG_INT, &prefetch_seconds,
+          "Seconds of adaptive stream segments to download ahead (default 30)", "SECONDS" },
+        { "max-bitrate", 0, 0, G_OPTION_ARG_INT, &max_bitrate,
+          "Highest variant bitrate to select for HLS/DASH, in bits per second", "BPS" },
+        { "startup-trace", 0, 0, G_OPTION_ARG_NONE, &trace_enabled,
+          "Print time-to-window and time-to-first-frame breakdown", NULL },
+        { "bench-decode", 0, 0, G_OPTION_ARG_FILENAME, &bench_decode,
+          "Time decoding FILE and its hover previews without opening a window", "FILE" },
+        { "batch", 0, 0, G_OPTION_ARG_STRING, &batch_mode,
+          "Process files and directories without a window: frames, sheet or transcode", "MODE" },
+        { NULL }
+    };
+    static GOptionEntry batch_entries[] = {
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &batch_output,
+          "Write results under DIR, mirroring the input tree (default vyn-batch)", "DIR" },
+        { "jobs", 'j', 0, G_OPTION_ARG_INT, &batch_jobs,
+          "Pipelines to run at once (default: one per core, within the memory budget)", "N" },
+        { "memory-budget", 0, 0, G_OPTION_ARG_INT, &batch_memory_mb,
+          "Memory for concurrent pipelines in MB (default: half of available memory)", "MB" },
+        { "interval", 0, 0, G_OPTION_ARG_DOUBLE, &batch_interval,
+          "frames: seconds between extracted frames (default 10)", "SECONDS" },
+        { "scene-threshold", 0, 0, G_OPTION_ARG_DOUBLE, &batch_scene,
+          "frames: extract the first frame of each scene instead; 0.1-0.3 suits most footage", "FRACTION" },
+        { "sheet-frames", 0, 0, G_OPTION_ARG_INT, &sheet_frames,
+          "sheet: frames per contact sheet (default 20)", "N" },
+        { "sheet-columns", 0, 0, G_OPTION_ARG_INT, &sheet_columns,
+          "sheet: frames per row (default 5)", "N" },
+        { "sheet-width", 0, 0, G_OPTION_ARG_INT, &sheet_width,
+          "sheet: width of each frame in pixels (default 320)", "PIXELS" },
+        { "profile", 0, 0, G_OPTION_ARG_STRING, &batch_profile,
+          "transcode: h264-1080p, h264-720p (default), h264-480p or vp8-480p", "NAME" },
+        { "force", 0, 0, G_OPTION_ARG_NONE, &batch_force,
+          "Redo outputs that are newer than their input", NULL },
+        { NULL }
+    };
+    GOptionGroup *batch_group;
+    gchar *location = NULL;
+    GOptionContext *context;
+    GError *error = NULL;
+    GtkWidget *toolbar;
+    GtkWidget *vbox;
+    VynPlayerApp app = {0};
+    GtkToolItem *open_toolitem, *location_toolitem, *prev_toolitem, *next_toolitem, *play_toolitem,
+                *pause_toolitem, *stop_toolitem, *fullscreen_toolitem, *separator;
+    
+    trace_start = g_get_monotonic_time();
+    
+    // Parse options before connecting to the display so --bench-decode and
+    // --batch run headless.
+    context = g_option_context_new("[FILE|URI] - Vyn Player");
+    g_option_context_set_summary(context, "Batch mode: vynplayer --batch=MODE [OPTION...] FILE|DIR...");
+    g_option_context_add_main_entries(context, entries, NULL);
+    batch_group = g_option_group_new("batch", "Batch Options:", "Show batch mode options", NULL, NULL);
+    g_option_group_add_entries(batch_group, batch_entries);
+    g_option_context_add_group(context, batch_group);
+    g_option_context_add_group(context, gtk_get_option_group(FALSE));
+    // GStreamer is initialized on the controller thread; only pay for it
+    // here when GStreamer options need parsing.
+    for (gint i = 1; i < argc; i++) {
+        if (g_str_has_prefix(argv[i], "--gst-")) {
+            g_option_context_add_group(context, gst_init_get_option_group());
+            break;
+        }
+    }
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    
+    if (bench_decode)
+        return run_decode_bench(bench_decode);
+    
+    if (batch_mode) {
+        BatchConfig config = {0};
+        const gchar *profile_name = batch_profile ? batch_profile : "h264-720p";
+        for (guint i = 0; i < G_N_ELEMENTS(transcode_profiles); i++)
+            if (g_str_equal(transcode_profiles[i].name, profile_name))
+                config.profile = &transcode_profiles[i];
+        
+        if (g_str_equal(batch_mode, "frames")) {
+            config.mode = BATCH_FRAMES;
+        } else if (g_str_equal(batch_mode, "sheet")) {
+            config.mode = BATCH_SHEET;
+        } else if (g_str_equal(batch_mode, "transcode")) {
+            config.mode = BATCH_TRANSCODE;
+        } else {
+            g_printerr("Unknown batch mode %s; use frames, sheet or transcode\n", batch_mode);
+            return 1;
+        }
+        if (!config.profile) {
+            g_printerr("Unknown transcode profile %s\n", profile_name);
+            return 1;
+        }
+        if (batch_interval <= 0 || batch_scene < 0 || batch_scene > 1 ||
+            sheet_frames < 1 || sheet_columns < 1 || sheet_width < 16) {
+            g_printerr("Invalid batch option value\n");
+            return 1;
+        }
+        if (argc < 2) {
+            g_printerr("--batch needs at least one file or directory\n");
+            return 1;
+        }
+        config.output_dir = g_strdup(batch_output ? batch_output : "vyn-batch");
+        config.interval = batch_interval;
+        config.scene_threshold = batch_scene;
+        config.sheet_frames = sheet_frames;
+        config.sheet_columns = sheet_columns;
+        config.sheet_width = sheet_width;
+        config.force = batch_force;
+        int status = run_batch(&config, argc - 1, argv + 1, batch_jobs, batch_memory_mb);
+        g_free(config.output_dir);
+        return status;
+    }
+    
+    gtk_init(&argc, &argv);
+    startup_trace("gtk initialized");
+    
+    g_print("Vyn Player starting...\n");
+    
+    // Resolve a file or URI given on the command line.
+    if (argc > 1) {
+        GFile *file = g_file_new_for_commandline_arg(argv[1]);
+        location = g_file_is_native(file) ? g_file_get_path(file) : g_file_get_uri(file);
+        g_object_unref(file);
+    }
+    
+    // Start the pipeline controller.
+    app.stream.cache_dir = cache_dir;
+    app.stream.cache_size_mb = cache_size_mb;
+    app.stream.prefetch_seconds = prefetch_seconds;
+    app.stream.max_bitrate = max_bitrate;
+    if (cache_dir && g_mkdir_with_parents(cache_dir, 0700) != 0) {
+        g_printerr("Cannot create cache directory %s, buffering in memory\n", cache_dir);
+        app.stream.cache_dir = NULL;
+    }
+    app.commands = g_async_queue_new();
+    app.rate = 1.0;
+    app.pipeline_rate = 1.0;
+    // gtksink calls GTK through g_main_context_invoke on the default context.
+    // Unowned, that runs the call inline on the controller thread, racing the
+    // widget creation below. Owning the context here until gtk_main() returns
+    // queues those calls for the main loop instead.
+    g_main_context_acquire(NULL);
+    // Queue the command line file first so the pipeline builds while the
+    // widgets are created.
+    if (location)
+        player_open(&app, location);
+    app.controller = g_thread_new("vyn-player-ctl", controller_thread, &app);
+    
+    // Start the hover preview worker.
+    g_mutex_init(&app.preview.lock);
+    g_cond_init(&app.preview.cond);
+    g_queue_init(&app.preview.lru);
+    app.preview.frames = g_hash_table_new(g_int64_hash, g_int64_equal);
+    app.preview.sprites_enabled = preview_sprites;
+    app.preview.thread = g_thread_new("vyn-player-preview", preview_thread, &app);
+    
+    // Create main window.
+    app.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(app.window), "Vyn Player");
+    gtk_window_set_default_size(GTK_WINDOW(app.window), 800, 600);
+    g_signal_connect(app.window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    g_signal_connect(app.window, "key-press-event", G_CALLBACK(key_press_event), &app);
+    
+    // Create main container.
+    vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_container_add(GTK_CONTAINER(app.window), vbox);
+    
+    // Create toolbar.
+    toolbar = gtk_toolbar_new();
+    gtk_box_pack_start(GTK_BOX(vbox), toolbar, FALSE, FALSE, 0);
+    
+    // Toolbar buttons.
+    open_toolitem = gtk_tool_button_new(gtk_image_new_from_icon_name("document-open", GTK_ICON_SIZE_LARGE_TOOLBAR), "Open");
+    g_signal_connect(open_toolitem, "clicked", G_CALLBACK(open_video), &app);
+    gtk_toolbar_insert(GTK_TOOLBAR(toolbar), GTK_TOOL_ITEM(open_toolitem), -1);
+    
+    location_toolitem = gtk_tool_button_new(gtk_image_new_from_icon_name("network-server", GTK_ICON_SIZE_LARGE_TOOLBAR), "Open Location");
+    g_signal_connect(location_toolitem, "clicked", G_CALLBACK(open_location), &app);
+    gtk_toolbar_insert(GTK_TOOLBAR(toolbar), GTK_TOOL_ITEM(location_toolitem), -1);
+    
+    separator = gtk_separator_tool_item_new();
+    gtk_toolbar_insert(GTK_TOOLBAR(toolbar), GTK_TOOL_ITEM(separator), -1);
     
     prev_toolitem = gtk_tool_button_new(gtk_image_new_from_icon_name("media-skip-backward", GTK_ICON_SIZE_LARGE_TOOLBAR), "Previous");
     g_object_set_data(G_OBJECT(prev_toolitem), "direction", GINT_TO_POINTER(-1));
@@ -561,6 +2678,18 @@ int main(int argc, char *argv[]) {
     gtk_container_add(GTK_CONTAINER(volume_toolitem), app.volume_button);
     gtk_toolbar_insert(GTK_TOOLBAR(toolbar), volume_toolitem, -1);
     
+    // Create info bar for non-modal error messages.
+    app.info_bar = gtk_info_bar_new();
+    gtk_info_bar_set_message_type(GTK_INFO_BAR(app.info_bar), GTK_MESSAGE_ERROR);
+    gtk_info_bar_set_show_close_button(GTK_INFO_BAR(app.info_bar), TRUE);
+    app.info_label = gtk_label_new(NULL);
+    gtk_label_set_line_wrap(GTK_LABEL(app.info_label), TRUE);
+    gtk_widget_show(app.info_label);
+    gtk_container_add(GTK_CONTAINER(gtk_info_bar_get_content_area(GTK_INFO_BAR(app.info_bar))), app.info_label);
+    g_signal_connect(app.info_bar, "response", G_CALLBACK(info_bar_response), &app);
+    gtk_widget_set_no_show_all(app.info_bar, TRUE);
+    gtk_box_pack_start(GTK_BOX(vbox), app.info_bar, FALSE, FALSE, 0);
+    
     // Create video container.
     app.video_container = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
     gtk_widget_set_hexpand(app.video_container, TRUE);
@@ -568,9 +2697,26 @@ int main(int argc, char *argv[]) {
     gtk_box_pack_start(GTK_BOX(vbox), app.video_container, TRUE, TRUE, 0);
     
     // Create progress bar.
+    // The progress bar has no window of its own, so an event box receives its input.
     app.progress_bar = gtk_progress_bar_new();
-    g_signal_connect(app.progress_bar, "button-press-event", G_CALLBACK(progress_bar_click), &app);
-    gtk_box_pack_start(GTK_BOX(vbox), app.progress_bar, FALSE, FALSE, 0);
+    app.progress_box = gtk_event_box_new();
+    gtk_widget_add_events(app.progress_box, GDK_POINTER_MOTION_MASK | GDK_LEAVE_NOTIFY_MASK);
+    gtk_container_add(GTK_CONTAINER(app.progress_box), app.progress_bar);
+    g_signal_connect(app.progress_box, "button-press-event", G_CALLBACK(progress_bar_click), &app);
+    g_signal_connect(app.progress_box, "motion-notify-event", G_CALLBACK(progress_bar_motion), &app);
+    g_signal_connect(app.progress_box, "leave-notify-event", G_CALLBACK(progress_bar_leave), &app);
+    gtk_box_pack_start(GTK_BOX(vbox), app.progress_box, FALSE, FALSE, 0);
+    
+    // Create hover preview popup.
+    GtkWidget *preview_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+    app.preview_window = gtk_window_new(GTK_WINDOW_POPUP);
+    gtk_window_set_transient_for(GTK_WINDOW(app.preview_window), GTK_WINDOW(app.window));
+    app.preview_image = gtk_image_new();
+    gtk_widget_set_size_request(app.preview_image, PREVIEW_WIDTH, PREVIEW_WIDTH * 9 / 16);
+    app.preview_label = gtk_label_new(NULL);
+    gtk_box_pack_start(GTK_BOX(preview_box), app.preview_image, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(preview_box), app.preview_label, FALSE, FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(app.preview_window), preview_box);
     
     // Create status bar.
     app.status_bar = gtk_statusbar_new();
@@ -580,14 +2726,34 @@ int main(int argc, char *argv[]) {
     gtk_widget_set_sensitive(app.pause_button, FALSE);
     gtk_widget_set_sensitive(app.stop_button, FALSE);
     
-    // Set up periodic progress updates.
-    app.timeout_id = g_timeout_add(250, update_progress, &app);
+    if (trace_enabled)
+        g_signal_connect(app.window, "draw", G_CALLBACK(window_first_draw), NULL);
     
     gtk_widget_show_all(app.window);
+    startup_trace("widgets created");
+    
+    if (location) {
+        if (gst_uri_is_valid(location)) {
+            app.video_list = g_list_append(NULL, g_strdup(location));
+            app.current_video = app.video_list;
+        } else {
+            load_video_list(&app, location);
+            // Keep the requested file current even if the list filter skipped it.
+            if (!app.current_video || g_strcmp0(app.current_video->data, location) != 0) {
+                app.video_list = g_list_insert_sorted(app.video_list, g_strdup(location), (GCompareFunc)g_strcmp0);
+                app.current_video = g_list_find_custom(app.video_list, location, (GCompareFunc)g_strcmp0);
+            }
+        }
+        reset_video_ui(&app, location);
+        g_free(location);
+    }
+    
     gtk_main();
     
+    // Tearing down the pipeline calls back into the default context; the
+    // controller has to be able to run that itself while main() joins it.
+    g_main_context_release(NULL);
     cleanup_gstreamer(&app);
     
     return 0;
 }
-
@@ -1,132 +1,3786 @@
+#define _GNU_SOURCE
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
 #include <vte/vte.h>
 #include <gtk/gtk.h>
 #include <glib.h>
+#include <glib-unix.h>
+#include <gio/gunixconnection.h>
+#include <gio/gunixsocketaddress.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+// Launching vyn-terminal again activates the running instance over D-Bus,
+// which opens a new window in the same process.
+#define APP_ID "org.vynos.Terminal"
+
+// Default scrollback. VTE keeps only a bounded window of rows in memory and
+// spills older history to a compressed, encrypted temp file, so unlimited
+// scrollback (-1) costs disk rather than RSS.
+#define DEFAULT_SCROLLBACK_LINES 10000
+
+// Bytes generated per benchmark workload unless --bench-size says otherwise
+#define DEFAULT_BENCH_MB 32
+
+// Output the session daemon keeps for a detached session. Older output is
+// dropped; the frontend's screen snapshot covers what came before it.
+#define SESSION_BACKLOG_MAX (256 * 1024)
+
+// Largest screen snapshot the daemon accepts from a frontend. A full screen
+// of text is a few hundred KB at most.
+#define SESSION_SNAPSHOT_MAX (1024 * 1024)
+
+// A frontend that starts the daemon retries its connection every
+// SESSION_CONNECT_INTERVAL ms, SESSION_CONNECT_TRIES times, while it comes up
+#define SESSION_CONNECT_INTERVAL 50
+#define SESSION_CONNECT_TRIES 40
+
+// Output tap: log batches are written once they reach TAP_FLUSH_BYTES or
+// after a second of quiet. A tap whose writer falls TAP_QUEUE_MAX bytes
+// behind drops output from the log rather than growing without bound.
+#define TAP_FLUSH_BYTES (64 * 1024)
+#define TAP_QUEUE_MAX (4 * 1024 * 1024)
+#define TRIGGER_LINE_MAX 4096
+#define TRIGGER_INTERVAL (5 * G_USEC_PER_SEC)  // Per trigger, per terminal
+
+// Pastes into tapped terminals are written to the PTY PASTE_CHUNK bytes at
+// a time, as fast as the program reading it keeps up. Pastes of
+// PASTE_PROGRESS_MIN or more show a progress bar.
+#define PASTE_CHUNK (16 * 1024)
+#define PASTE_PROGRESS_MIN (256 * 1024)
+
+// --measure-latency prints a running summary every LATENCY_REPORT_EVERY
+// keystrokes, and a final one when the window closes. A keystroke with no
+// echo within LATENCY_ECHO_TIMEOUT is not counted.
+#define LATENCY_REPORT_EVERY 100
+#define LATENCY_ECHO_TIMEOUT G_USEC_PER_SEC
+
+// Settings from ~/.config/vyn-terminal/config.ini, all in a [terminal] group:
+//
+//   shell=/bin/zsh              args=-l;                cwd=~/work
+//   env=EDITOR=vim;LANG=C.UTF-8;
+//   foreground=#F8F8F2          background=#282828      palette=#000;#c00;...
+//   font=Monospace 11           scrollback=-1           prewarm=1
+//   log_dir=~/logs              log_max_mb=16           log_keep=4
+//   trigger.build=make(\[\d+\])?: Leaving directory
+//   trigger.error=\b(error|FAILED)\b
+typedef struct {
+    char *shell;
+    char **args;
+    char *cwd;
+    char **env;
+    GdkRGBA foreground;
+    GdkRGBA background;
+    GdkRGBA palette[16];
+    gsize palette_size;
+    PangoFontDescription *font;
+    glong scrollback_lines;
+    gint prewarm;                  // Shells kept started for new tabs and windows
+    char *log_dir;                 // Set when configured; logging still starts with Ctrl+Shift+L
+    gint64 log_max_bytes;
+    gint log_keep;
+    GRegex *triggers;              // All trigger.* patterns as one alternation
+    char **trigger_names;
+    guint n_triggers;
+} TerminalConfig;
+
+// --startup-trace state for one launch, attached to its first terminal as
+// "vyn-trace". Output goes to the launching process, even when the launch was
+// forwarded to a running instance.
+typedef struct {
+    GApplicationCommandLine *command_line;
+    gint64 start;
+} StartupTrace;
+
+// Settings a window is created with. New windows copy their opener's.
+typedef struct {
+    glong scrollback_lines;
+    gboolean coalesce_redraws;     // Cap repaints to the refresh rate under flood
+    gboolean use_sessions;         // Shells run in the session daemon
+    gboolean tap_output;           // Terminals read their own PTY (logging, triggers, low latency)
+    gboolean log_output;           // Start logging as soon as the terminal opens
+    gboolean low_latency;          // No blink or kinetic scrolling, PTY read ahead of redraws
+    gboolean measure_latency;      // Report keystroke-to-screen latency
+} WindowSettings;
+
+// A painted frame that showed a keystroke's echo, waiting for the frame
+// clock to learn when it reached the screen
+typedef struct {
+    gint64 frame;
+    gint64 key_time;
+    gint64 paint_time;
+} LatencyFrame;
+
+// --measure-latency state for a window. A keystroke is timed from its event
+// time to the presentation of the first frame painted after the focused
+// terminal's contents change. A new key replaces one still waiting for its
+// echo, since keys without a visible echo (passwords, ignored keys) would
+// otherwise be timed against unrelated output; keys typed while an echo
+// waits to be painted are not counted.
+typedef struct {
+    gint64 key_time;               // Keystroke awaiting its echo, 0 if none
+    gboolean echoed;               // Its echo is waiting to be painted
+    GArray *frames;                // LatencyFrame
+    GArray *samples;               // Milliseconds
+    guint presented;               // Samples with a compositor presentation time
+} LatencyProbe;
+
+typedef enum {
+    ESCAPE_NONE,
+    ESCAPE_START,
+    ESCAPE_CSI,
+    ESCAPE_STRING,
+    ESCAPE_STRING_END
+} EscapeState;
+
+// Output tap, attached to a terminal as "vyn-tap". The terminal reads its
+// own PTY, feeds VTE, and hands the same chunks to a worker thread that
+// batches them into a rotating log and matches trigger patterns, so neither
+// slows rendering. The worker frees the tap once its terminal is gone.
+typedef struct {
+    // Main thread
+    VtePty *pty;
+    guint read_source;
+    guint write_source;
+    gint read_priority;
+    GByteArray *pending_input;     // Input the PTY was not ready to take
+    GAsyncQueue *chunks;           // GBytes for the worker; the tap itself means quit
+    gint queued;                   // Bytes in chunks, atomic
+    GWeakRef terminal;
+    gint logging;                  // Atomic
+    char *log_path;
+    gboolean bracketed_paste;      // The program asked for bracketed paste (mode 2004)
+    
+    // Worker thread
+    FILE *log;
+    gint64 log_size;
+    GByteArray *batch;
+    gint dropped;                  // Atomic
+    GString *line;
+    EscapeState escape;
+    gint64 *last_fired;
+} OutputTap;
+
+// A trigger match, passed from a tap worker to the main thread
+typedef struct {
+    VteTerminal *terminal;
+    guint trigger;
+    char *line;
+} TriggerHit;
+
+// A paste being streamed into a tapped terminal's PTY. The tap knows the
+// program's bracketed paste mode, so the paste is converted and written
+// here: newlines are sent as carriage returns, as VTE does, and in bracketed
+// mode ESC is dropped so the text cannot end the bracket early.
+typedef struct {
+    VteTerminal *terminal;
+    gulong destroy_handler;
+    int fd;
+    char *text;
+    gsize length;
+    gsize offset;                  // Into text; converted bytes wait in out
+    gboolean bracketed;
+    gboolean closed;               // Closing bracket queued
+    gboolean after_cr;
+    gsize sent;                    // Bytes written to the PTY
+    GByteArray *out;
+    guint write_source;
+} PasteJob;
+
+// A Ctrl+Shift+C copy whose text is only taken from the terminal when an
+// application asks for it, or just before the selection could change.
+// Attached to the terminal as "vyn-copy" until then.
+typedef struct {
+    GWeakRef terminal;
+    char *text;
+} ClipboardCopy;
+
+// Per-window state, attached to the GtkWindow as "vyn-window".
+typedef struct {
+    GtkWidget *notebook;
+    GtkWidget *search_bar;
+    GtkWidget *search_entry;
+    GtkWidget *search_regex;
+    VteTerminal *search_terminal;  // Weak; cleared when the terminal goes away
+    WindowSettings settings;
+    gint64 last_flush;
+    guint thaw_source;
+    LatencyProbe *latency;         // Only with --measure-latency
+    PasteJob *paste;               // One streamed paste per window at a time
+    GtkWidget *paste_bar;
+    GtkWidget *paste_label;
+    GtkWidget *paste_progress;
+} TerminalWindow;
+
+typedef struct Bench Bench;
+
+// A generated benchmark workload
+typedef struct {
+    const char *name;
+    void (*generate)(GString *out, gsize size);
+} BenchWorkload;
+
+// State of a --bench run. Each workload runs with coalescing off, then on.
+struct Bench {
+    GtkWidget *window;
+    VteTerminal *terminal;
+    gsize size;
+    guint run;
+    GString *data;
+    VtePty *pty;
+    int slave_fd;
+    GThread *writer;
+    char *marker;
+    gint64 start_time;
+    gint64 end_time;
+    gint64 draw_start;
+    GArray *draw_times;
+    int status;
+};
+
+// Frontend side of a terminal whose shell lives in the session daemon,
+// attached to the VteTerminal as "vyn-session". Messages to the daemon are
+// written without blocking; a snapshot still waiting behind a slow daemon
+// is replaced by the next one rather than queued.
+typedef struct {
+    GSocketConnection *connection;
+    guint id;
+    guint snapshot_source;
+    gboolean killed;
+    GString *next_snapshot;        // SNAPSHOT message waiting to be written
+    gboolean close_pending;        // CLOSE waiting to be written
+    GByteArray *out;               // Message being written
+    guint write_source;            // Waiting for the socket to take more
+    gboolean detached;             // The terminal is gone; freed once out is written
+} TerminalSession;
+
+// A shell owned by the session daemon
+typedef struct {
+    guint id;
+    VtePty *pty;
+    GPid pid;
+    GByteArray *snapshot;          // Last screen sent by the frontend
+    GByteArray *backlog;           // Output read while detached
+    guint read_source;
+    gboolean closed;               // Hung up by CLOSE, waiting for the shell to exit
+    struct DaemonClient *client;   // Attached frontend, if any
+} Session;
+
+// A frontend connection to the session daemon. Replies are queued and
+// written without blocking, so a frontend that stops reading stalls only
+// itself; its next request is read once its replies are out.
+typedef struct DaemonClient {
+    gint refs;                     // One while open, one per operation in flight
+    gboolean closed;
+    GCancellable *cancellable;     // Cancelled on close
+    GSocketConnection *connection;
+    GDataInputStream *input;
+    Session *session;
+    GQueue replies;                // DaemonReply, oldest first
+    gboolean writing;              // The head of replies is being written
+    gboolean read_waiting;         // The next request waits for replies to drain
+    guint8 *snapshot;              // SNAPSHOT payload being read
+    gsize snapshot_length;         // Its length, or the bytes left to skip
+} DaemonClient;
+
+// Queued output for a frontend: bytes, or a PTY master to pass if bytes is NULL
+typedef struct {
+    GBytes *bytes;
+    int fd;
+} DaemonReply;
+
+static TerminalConfig config;
+static gint64 process_start;
+
+// Prewarmed terminals, shells already running in the pool directory
+static GQueue shell_pool = G_QUEUE_INIT;
+static guint pool_refill_source;
+
+static GHashTable *daemon_sessions;
+static GMainLoop *daemon_loop;
+static guint daemon_next_id = 1;
+
+static GtkWidget *create_terminal(GtkWidget *window, const char *working_directory, guint attach_id);
+static void add_tab(GtkWidget *window, const char *working_directory, guint attach_id);
+static GtkWidget *create_window(GtkApplication *app, const char *working_directory,
+                                const WindowSettings *settings, guint attach_id);
+static void tap_toggle_logging(VteTerminal *terminal);
+static void terminal_start_local(VteTerminal *terminal, const char *working_directory,
+                                 const WindowSettings *settings);
+
+static TerminalWindow *
+window_get_state(GtkWidget *window)
+{
+    return g_object_get_data(G_OBJECT(window), "vyn-window");
+}
+
+static GtkNotebook *
+window_get_notebook(GtkWidget *window)
+{
+    return GTK_NOTEBOOK(window_get_state(window)->notebook);
+}
+
+// Return the notebook page holding the widget, or NULL if it is not in one.
+static GtkWidget *
+widget_get_page(GtkWidget *widget)
+{
+    GtkWidget *parent = gtk_widget_get_parent(widget);
+    while (parent && !GTK_IS_NOTEBOOK(parent)) {
+        widget = parent;
+        parent = gtk_widget_get_parent(widget);
+    }
+    return parent ? widget : NULL;
+}
+
+// Return the first terminal found in a pane tree.
+static VteTerminal *
+find_terminal(GtkWidget *widget)
+{
+    if (VTE_IS_TERMINAL(widget))
+        return VTE_TERMINAL(widget);
+    if (GTK_IS_PANED(widget)) {
+        VteTerminal *terminal = find_terminal(gtk_paned_get_child1(GTK_PANED(widget)));
+        return terminal ? terminal : find_terminal(gtk_paned_get_child2(GTK_PANED(widget)));
+    }
+    if (GTK_IS_BIN(widget))
+        return find_terminal(gtk_bin_get_child(GTK_BIN(widget)));
+    return NULL;
+}
+
+// Working directory of the shell, when it reports one through OSC 7.
+static char *
+terminal_get_directory(VteTerminal *terminal)
+{
+    const char *uri = vte_terminal_get_current_directory_uri(terminal);
+    return uri ? g_filename_from_uri(uri, NULL, NULL) : NULL;
+}
+
+// Put a widget in the place of another inside a notebook page or a paned.
+// The old widget is removed, so callers keep a reference if they need it.
+static void
+replace_widget(GtkWidget *old_widget, GtkWidget *new_widget)
+{
+    GtkWidget *parent = gtk_widget_get_parent(old_widget);
+    
+    if (GTK_IS_NOTEBOOK(parent)) {
+        GtkNotebook *notebook = GTK_NOTEBOOK(parent);
+        gint index = gtk_notebook_page_num(notebook, old_widget);
+        GtkWidget *label = g_object_ref(gtk_notebook_get_tab_label(notebook, old_widget));
+        
+        gtk_notebook_remove_page(notebook, index);
+        gtk_notebook_insert_page(notebook, new_widget, label, index);
+        gtk_notebook_set_tab_reorderable(notebook, new_widget, TRUE);
+        gtk_widget_show(new_widget);
+        gtk_notebook_set_current_page(notebook, index);
+        g_object_unref(label);
+    } else if (GTK_IS_PANED(parent)) {
+        GtkPaned *paned = GTK_PANED(parent);
+        gboolean first = gtk_paned_get_child1(paned) == old_widget;
+        
+        gtk_container_remove(GTK_CONTAINER(paned), old_widget);
+        if (first)
+            gtk_paned_pack1(paned, new_widget, TRUE, FALSE);
+        else
+            gtk_paned_pack2(paned, new_widget, TRUE, FALSE);
+    }
+}
+
+// Remove a terminal's pane, collapsing its split or closing its tab. The
+// window closes with its last tab.
+static void
+close_terminal(VteTerminal *terminal)
+{
+    GtkWidget *pane = gtk_widget_get_parent(GTK_WIDGET(terminal));
+    GtkWidget *parent = pane ? gtk_widget_get_parent(pane) : NULL;
+    
+    if (GTK_IS_PANED(parent)) {
+        GtkPaned *paned = GTK_PANED(parent);
+        GtkWidget *sibling = gtk_paned_get_child1(paned) == pane ?
+            gtk_paned_get_child2(paned) : gtk_paned_get_child1(paned);
+        
+        g_object_ref(sibling);
+        gtk_container_remove(GTK_CONTAINER(paned), sibling);
+        replace_widget(GTK_WIDGET(paned), sibling);
+        
+        VteTerminal *next = find_terminal(sibling);
+        if (next)
+            gtk_widget_grab_focus(GTK_WIDGET(next));
+        g_object_unref(sibling);
+    } else if (GTK_IS_NOTEBOOK(parent)) {
+        GtkNotebook *notebook = GTK_NOTEBOOK(parent);
+        GtkWidget *window = gtk_widget_get_toplevel(parent);
+        
+        gtk_notebook_remove_page(notebook, gtk_notebook_page_num(notebook, pane));
+        if (gtk_notebook_get_n_pages(notebook) == 0)
+            gtk_widget_destroy(window);
+    }
+}
+
+// Split the terminal's pane, starting a new shell beside or below it.
+static void
+split_terminal(VteTerminal *terminal, GtkOrientation orientation)
+{
+    GtkWidget *pane = gtk_widget_get_parent(GTK_WIDGET(terminal));
+    GtkWidget *paned = gtk_paned_new(orientation);
+    GtkAllocation allocation;
+    char *directory = terminal_get_directory(terminal);
+    GtkWidget *new_pane = create_terminal(gtk_widget_get_toplevel(pane), directory, 0);
+    g_free(directory);
+    
+    gtk_widget_get_allocation(pane, &allocation);
+    
+    g_object_ref(pane);
+    replace_widget(pane, paned);
+    gtk_paned_pack1(GTK_PANED(paned), pane, TRUE, FALSE);
+    gtk_paned_pack2(GTK_PANED(paned), new_pane, TRUE, FALSE);
+    g_object_unref(pane);
+    
+    // Split evenly
+    if (orientation == GTK_ORIENTATION_HORIZONTAL)
+        gtk_paned_set_position(GTK_PANED(paned), allocation.width / 2);
+    else
+        gtk_paned_set_position(GTK_PANED(paned), allocation.height / 2);
+    
+    gtk_widget_show_all(paned);
+    gtk_widget_grab_focus(GTK_WIDGET(find_terminal(new_pane)));
+}
+
+// Check whether the terminal is the one focused (or last focused) in its tab.
+static gboolean
+terminal_is_tab_focus(GtkWidget *page, VteTerminal *terminal)
+{
+    GtkWidget *widget = page;
+    while (GTK_IS_CONTAINER(widget) && widget != GTK_WIDGET(terminal))
+        widget = gtk_container_get_focus_child(GTK_CONTAINER(widget));
+    
+    // A tab whose only pane was never focused still follows that pane.
+    if (!widget)
+        return gtk_widget_get_parent(GTK_WIDGET(terminal)) == page;
+    return widget == GTK_WIDGET(terminal);
+}
+
+static void latency_probe_free(LatencyProbe *probe);
+static void paste_finish(TerminalWindow *state);
+
+static void
+terminal_window_free(gpointer data)
+{
+    TerminalWindow *state = data;
+    if (state->thaw_source)
+        g_source_remove(state->thaw_source);
+    if (state->paste)
+        paste_finish(state);
+    if (state->latency)
+        latency_probe_free(state->latency);
+    g_free(state);
+}
+
+// Time between frames on the window's monitor, in microseconds.
+static gint64
+window_frame_interval(GtkWidget *window)
+{
+    GdkMonitor *monitor = gdk_display_get_monitor_at_window(gtk_widget_get_display(window),
+                                                            gtk_widget_get_window(window));
+    int refresh = monitor ? gdk_monitor_get_refresh_rate(monitor) : 0;  // millihertz
+    if (refresh <= 0)
+        refresh = 60000;
+    return G_USEC_PER_SEC * (gint64)1000 / refresh;
+}
+
+static int
+compare_doubles(gconstpointer a, gconstpointer b)
+{
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return (x > y) - (x < y);
+}
+
+static gdouble
+percentile(GArray *sorted, gdouble fraction)
+{
+    if (sorted->len == 0)
+        return 0.0;
+    return g_array_index(sorted, gdouble, MIN(sorted->len - 1, (guint)(fraction * sorted->len)));
+}
+
+static void
+latency_report(LatencyProbe *probe, const char *when)
+{
+    GArray *sorted;
+    
+    if (probe->samples->len == 0)
+        return;
+    sorted = g_array_sized_new(FALSE, FALSE, sizeof(gdouble), probe->samples->len);
+    g_array_append_vals(sorted, probe->samples->data, probe->samples->len);
+    g_array_sort(sorted, compare_doubles);
+    g_print("Input latency (%s): %u keys, p50 %.1f ms, p99 %.1f ms, max %.1f ms, %u%% presentation-timed\n",
+            when, sorted->len, percentile(sorted, 0.50), percentile(sorted, 0.99),
+            g_array_index(sorted, gdouble, sorted->len - 1),
+            100 * probe->presented / sorted->len);
+    g_array_unref(sorted);
+}
+
+static void
+latency_probe_free(LatencyProbe *probe)
+{
+    latency_report(probe, "window closed");
+    g_array_unref(probe->frames);
+    g_array_unref(probe->samples);
+    g_free(probe);
+}
+
+// Start timing a keystroke that goes to the shell. Key event times are in
+// milliseconds of the display server's clock, which on both X11 and Wayland
+// is the monotonic clock; when that does not hold, time from now instead.
+static void
+latency_key_pressed(GtkWidget *window, GdkEventKey *event)
+{
+    TerminalWindow *state = window_get_state(window);
+    gint64 now = g_get_monotonic_time();
+    guint32 queued;
+    
+    if (!state || !state->latency || event->is_modifier || state->latency->echoed)
+        return;
+    queued = (guint32)(now / 1000) - event->time;
+    state->latency->key_time = queued < 1000 ? now - queued * (gint64)1000 : now;
+}
+
+static void
+latency_contents_changed(TerminalWindow *state, VteTerminal *terminal)
+{
+    LatencyProbe *probe = state->latency;
+    
+    if (!probe || !probe->key_time || probe->echoed || !gtk_widget_has_focus(GTK_WIDGET(terminal)))
+        return;
+    // Too late to be this key's echo; drop the key without a sample
+    if (g_get_monotonic_time() - probe->key_time > LATENCY_ECHO_TIMEOUT)
+        probe->key_time = 0;
+    else
+        probe->echoed = TRUE;
+}
+
+// Runs after every frame the window paints. Frames showing an echo are
+// kept until their timings are complete; the presentation time is used when
+// the compositor reports one, the end of painting otherwise.
+static void
+on_latency_after_paint(GdkFrameClock *clock, gpointer user_data)
+{
+    TerminalWindow *state = window_get_state(GTK_WIDGET(user_data));
+    LatencyProbe *probe = state->latency;
+    guint i = 0;
+    
+    if (probe->echoed) {
+        LatencyFrame frame = {
+            gdk_frame_clock_get_frame_counter(clock), probe->key_time, g_get_monotonic_time()
+        };
+        g_array_append_val(probe->frames, frame);
+        probe->key_time = 0;
+        probe->echoed = FALSE;
+    }
+    
+    while (i < probe->frames->len) {
+        LatencyFrame *frame = &g_array_index(probe->frames, LatencyFrame, i);
+        GdkFrameTimings *timings = gdk_frame_clock_get_timings(clock, frame->frame);
+        gint64 shown = frame->paint_time;
+        gdouble ms;
+        
+        // Timings for old frames are dropped from the clock's history
+        if (timings && !gdk_frame_timings_get_complete(timings)) {
+            i++;
+            continue;
+        }
+        if (timings && gdk_frame_timings_get_presentation_time(timings) > 0) {
+            shown = gdk_frame_timings_get_presentation_time(timings);
+            probe->presented++;
+        }
+        ms = (shown - frame->key_time) / 1000.0;
+        g_array_append_val(probe->samples, ms);
+        g_array_remove_index(probe->frames, i);
+        if (probe->samples->len % LATENCY_REPORT_EVERY == 0)
+            latency_report(probe, "running");
+    }
+}
+
+static void
+on_latency_realize(GtkWidget *window, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    g_signal_connect_object(gtk_widget_get_frame_clock(window), "after-paint",
+                            G_CALLBACK(on_latency_after_paint), window, 0);
+}
+
+static gboolean
+coalesce_thaw(gpointer user_data)
+{
+    GtkWidget *window = user_data;
+    TerminalWindow *state = window_get_state(window);
+    
+    state->thaw_source = 0;
+    state->last_flush = g_get_monotonic_time();
+    gdk_window_thaw_updates(gtk_widget_get_window(window));
+    return G_SOURCE_REMOVE;
+}
+
+// With coalescing on, the first change after a quiet frame paints right
+// away; further changes within the same frame interval hold the window's
+// updates frozen until the interval ends, so flood output paints at most
+// once per display refresh.
+static void
+on_contents_changed(VteTerminal *terminal, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(terminal));
+    TerminalWindow *state = window_get_state(window);
+    GdkWindow *gdk_window = gtk_widget_get_window(window);
+    gint64 now, interval;
+    
+    if (state)
+        latency_contents_changed(state, terminal);
+    if (!state || !state->settings.coalesce_redraws || !gdk_window || state->thaw_source)
+        return;
+    
+    now = g_get_monotonic_time();
+    interval = window_frame_interval(window);
+    if (now - state->last_flush >= interval) {
+        state->last_flush = now;
+        return;
+    }
+    
+    gdk_window_freeze_updates(gdk_window);
+    state->thaw_source = g_timeout_add(MAX(1, (state->last_flush + interval - now) / 1000),
+                                       coalesce_thaw, window);
+}
+
+static void
+update_titles(VteTerminal *terminal)
+{
+    GtkWidget *page = widget_get_page(GTK_WIDGET(terminal));
+    const char *title = vte_terminal_get_window_title(terminal);
+    
+    if (!page)
+        return;
+    
+    if (terminal_is_tab_focus(page, terminal)) {
+        GtkWidget *window = gtk_widget_get_toplevel(page);
+        GtkWidget *label = gtk_notebook_get_tab_label(window_get_notebook(window), page);
+        gtk_label_set_text(GTK_LABEL(label), title ? title : "Terminal");
+    }
+    
+    if (gtk_widget_has_focus(GTK_WIDGET(terminal))) {
+        GtkWindow *window = GTK_WINDOW(gtk_widget_get_toplevel(page));
+        if (title) {
+            char *full_title = g_strdup_printf("Vyn Terminal - %s", title);
+            gtk_window_set_title(window, full_title);
+            g_free(full_title);
+        } else {
+            gtk_window_set_title(window, "Vyn Terminal");
+        }
+    }
+}
+
+static void
+startup_trace(VteTerminal *terminal, const char *event)
+{
+    StartupTrace *trace = g_object_get_data(G_OBJECT(terminal), "vyn-trace");
+    if (trace)
+        g_application_command_line_printerr(trace->command_line, "[startup] %8.2f ms  %s\n",
+                                            (g_get_monotonic_time() - trace->start) / 1000.0, event);
+}
+
+static void
+startup_trace_free(gpointer data)
+{
+    StartupTrace *trace = data;
+    g_object_unref(trace->command_line);
+    g_free(trace);
+}
+
+// The shell's first output is its prompt
+static void
+on_trace_contents_changed(VteTerminal *terminal, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    startup_trace(terminal, "first prompt");
+    g_signal_handlers_disconnect_by_func(terminal, G_CALLBACK(on_trace_contents_changed), NULL);
+    // Releasing the command line lets the launching process exit
+    g_object_set_data(G_OBJECT(terminal), "vyn-trace", NULL);
+}
+
+static gboolean
+on_trace_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)cr;
+    
+    VteTerminal *terminal = user_data;
+    startup_trace(terminal, "window drawn");
+    g_signal_handlers_disconnect_by_func(widget, G_CALLBACK(on_trace_draw), user_data);
+    
+    // A prewarmed shell has shown its prompt already
+    if (g_object_get_data(G_OBJECT(terminal), "vyn-prewarmed"))
+        on_trace_contents_changed(terminal, NULL);
+    return FALSE;
+}
 
 static void
 child_ready(VteTerminal *terminal, GPid pid, GError *error, gpointer user_data)
 {
     // Suppress unused parameter warnings
-    (void)terminal;
-    (void)pid;
-    (void)user_data;
+    (void)pid;
+    (void)user_data;
+    
+    if (!error)
+        startup_trace(terminal, "shell spawned");
+    if (error) {
+        // Cancelled when the pane was closed before the shell started
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("Error launching shell: %s\n", error->message);
+            // Stop prewarming rather than retrying a shell that cannot start
+            if (g_queue_remove(&shell_pool, terminal)) {
+                config.prewarm = 0;
+                g_object_unref(terminal);
+            } else {
+                close_terminal(terminal);
+            }
+        }
+        g_error_free(error);
+    }
+}
+
+static void pool_schedule_refill(void);
+
+static void
+on_child_exited(VteTerminal *terminal, gint status, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)status;
+    (void)user_data;
+    
+    // A prewarmed shell died before it was used
+    if (g_queue_remove(&shell_pool, terminal)) {
+        g_object_unref(terminal);
+        pool_schedule_refill();
+        return;
+    }
+    close_terminal(terminal);
+}
+
+static void
+config_color(GKeyFile *file, const char *key, GdkRGBA *color)
+{
+    char *value = g_key_file_get_string(file, "terminal", key, NULL);
+    if (value && !gdk_rgba_parse(color, value))
+        g_printerr("Ignoring invalid %s colour '%s'\n", key, value);
+    g_free(value);
+}
+
+// Compile every trigger.<name> key into a single alternation with one named
+// group per trigger, so each output line is matched in one pass however many
+// triggers there are. Invalid patterns are reported and skipped.
+static void
+config_triggers(GKeyFile *file)
+{
+    char **keys = g_key_file_get_keys(file, "terminal", NULL, NULL);
+    GString *combined = g_string_new(NULL);
+    GPtrArray *names = g_ptr_array_new();
+    GError *error = NULL;
+    
+    for (int i = 0; keys && keys[i]; i++) {
+        char *pattern;
+        GRegex *regex;
+        
+        if (!g_str_has_prefix(keys[i], "trigger.") || !keys[i][8])
+            continue;
+        pattern = g_key_file_get_string(file, "terminal", keys[i], NULL);
+        regex = pattern ? g_regex_new(pattern, 0, 0, &error) : NULL;
+        if (!regex) {
+            g_printerr("Ignoring %s: %s\n", keys[i], error ? error->message : "no pattern");
+            g_clear_error(&error);
+            g_free(pattern);
+            continue;
+        }
+        g_regex_unref(regex);
+        
+        g_string_append_printf(combined, "%s(?<t%u>%s)", combined->len ? "|" : "", names->len, pattern);
+        g_ptr_array_add(names, g_strdup(keys[i] + 8));
+        g_free(pattern);
+    }
+    g_strfreev(keys);
+    
+    if (names->len > 0) {
+        config.triggers = g_regex_new(combined->str, G_REGEX_OPTIMIZE | G_REGEX_DUPNAMES, 0, &error);
+        if (!config.triggers) {
+            g_printerr("Failed to combine triggers: %s\n", error->message);
+            g_error_free(error);
+        }
+    }
+    config.n_triggers = config.triggers ? names->len : 0;
+    g_ptr_array_add(names, NULL);
+    config.trigger_names = (char **)g_ptr_array_free(names, FALSE);
+    g_string_free(combined, TRUE);
+}
+
+// Load the config file over the built-in defaults. A missing file is fine.
+static void
+config_load(void)
+{
+    GKeyFile *file = g_key_file_new();
+    GError *error = NULL;
+    char *path = g_build_filename(g_get_user_config_dir(), "vyn-terminal", "config.ini", NULL);
+    char **palette;
+    char *font;
+    
+    gdk_rgba_parse(&config.background, "#282828");
+    gdk_rgba_parse(&config.foreground, "#F8F8F2");
+    config.scrollback_lines = DEFAULT_SCROLLBACK_LINES;
+    config.log_max_bytes = 16 * 1024 * 1024;
+    config.log_keep = 4;
+    
+    if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_printerr("Failed to read %s: %s\n", path, error->message);
+        g_error_free(error);
+        g_key_file_free(file);
+        g_free(path);
+        return;
+    }
+    
+    config.shell = g_key_file_get_string(file, "terminal", "shell", NULL);
+    config.args = g_key_file_get_string_list(file, "terminal", "args", NULL, NULL);
+    config.env = g_key_file_get_string_list(file, "terminal", "env", NULL, NULL);
+    config.cwd = g_key_file_get_string(file, "terminal", "cwd", NULL);
+    if (config.cwd && config.cwd[0] == '~') {
+        char *expanded = g_build_filename(g_get_home_dir(), config.cwd + 1, NULL);
+        g_free(config.cwd);
+        config.cwd = expanded;
+    }
+    
+    config_color(file, "foreground", &config.foreground);
+    config_color(file, "background", &config.background);
+    palette = g_key_file_get_string_list(file, "terminal", "palette", NULL, NULL);
+    for (gsize i = 0; palette && palette[i] && i < G_N_ELEMENTS(config.palette); i++) {
+        if (!gdk_rgba_parse(&config.palette[i], palette[i])) {
+            g_printerr("Ignoring invalid palette '%s'\n", palette[i]);
+            config.palette_size = 0;
+            break;
+        }
+        config.palette_size = i + 1;
+    }
+    // VTE takes 0, 8, 16, 232 or 256 palette entries
+    if (config.palette_size != 8 && config.palette_size != 16)
+        config.palette_size = 0;
+    g_strfreev(palette);
+    
+    font = g_key_file_get_string(file, "terminal", "font", NULL);
+    if (font)
+        config.font = pango_font_description_from_string(font);
+    g_free(font);
+    
+    if (g_key_file_has_key(file, "terminal", "scrollback", NULL))
+        config.scrollback_lines = MAX(-1, g_key_file_get_int64(file, "terminal", "scrollback", NULL));
+    config.prewarm = CLAMP(g_key_file_get_integer(file, "terminal", "prewarm", NULL), 0, 8);
+    
+    config.log_dir = g_key_file_get_string(file, "terminal", "log_dir", NULL);
+    if (config.log_dir && config.log_dir[0] == '~') {
+        char *expanded = g_build_filename(g_get_home_dir(), config.log_dir + 1, NULL);
+        g_free(config.log_dir);
+        config.log_dir = expanded;
+    }
+    if (g_key_file_has_key(file, "terminal", "log_max_mb", NULL))
+        config.log_max_bytes = MAX(1, g_key_file_get_int64(file, "terminal", "log_max_mb", NULL)) * 1024 * 1024;
+    if (g_key_file_has_key(file, "terminal", "log_keep", NULL))
+        config.log_keep = CLAMP(g_key_file_get_integer(file, "terminal", "log_keep", NULL), 0, 100);
+    config_triggers(file);
+    
+    g_key_file_free(file);
+    g_free(path);
+}
+
+// Command line for new shells: the configured shell, else zsh, else bash.
+static char **
+shell_argv(void)
+{
+    GPtrArray *argv = g_ptr_array_new();
+    
+    if (config.shell)
+        g_ptr_array_add(argv, g_strdup(config.shell));
+    else if (g_file_test("/bin/zsh", G_FILE_TEST_EXISTS))
+        g_ptr_array_add(argv, g_strdup("/bin/zsh"));
+    else
+        g_ptr_array_add(argv, g_strdup("/bin/bash"));  // Fallback to bash if zsh is not available
+    
+    for (int i = 0; config.args && config.args[i]; i++)
+        g_ptr_array_add(argv, g_strdup(config.args[i]));
+    g_ptr_array_add(argv, NULL);
+    return (char **)g_ptr_array_free(argv, FALSE);
+}
+
+// Environment for new shells, with the configured variables applied.
+static char **
+shell_environ(void)
+{
+    char **envp = g_get_environ();
+    
+    for (int i = 0; config.env && config.env[i]; i++) {
+        char **pair = g_strsplit(config.env[i], "=", 2);
+        if (pair[0] && pair[1])
+            envp = g_environ_setenv(envp, pair[0], pair[1], TRUE);
+        g_strfreev(pair);
+    }
+    return envp;
+}
+
+// Start the configured shell on a PTY we read ourselves, with the same
+// environment VTE would give it.
+static gboolean
+spawn_on_pty(VtePty *pty, const char *working_directory, GPid *pid, GError **error)
+{
+    char **argv = shell_argv();
+    char **envp = shell_environ();
+    gboolean spawned;
+    
+    envp = g_environ_setenv(envp, "TERM", "xterm-256color", TRUE);
+    envp = g_environ_setenv(envp, "COLORTERM", "truecolor", TRUE);
+    spawned = g_spawn_async(working_directory, argv, envp,
+                            G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                            (GSpawnChildSetupFunc)vte_pty_child_setup, pty, pid, error);
+    g_strfreev(envp);
+    g_strfreev(argv);
+    return spawned;
+}
+
+static char *
+session_socket_path(void)
+{
+    return g_build_filename(g_get_user_runtime_dir(), "vyn-terminal", "sessions.sock", NULL);
+}
+
+static void
+daemon_child_setup(gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    // Leave the frontend's session so its hangup does not reach the daemon
+    setsid();
+}
+
+// Connect to a running session daemon.
+static GSocketConnection *
+session_connect(GError **error)
+{
+    GSocketClient *client = g_socket_client_new();
+    char *path = session_socket_path();
+    GSocketAddress *address = g_unix_socket_address_new(path);
+    GSocketConnection *connection;
+    
+    connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address), NULL, error);
+    g_object_unref(address);
+    g_free(path);
+    g_object_unref(client);
+    return connection;
+}
+
+static gboolean
+session_daemon_spawn(GError **error)
+{
+    char *self = g_file_read_link("/proc/self/exe", NULL);
+    char *argv[] = { self ? self : "vyn-terminal", "--daemon", NULL };
+    gboolean spawned;
+    
+    spawned = g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
+                            daemon_child_setup, NULL, NULL, error);
+    g_free(self);
+    return spawned;
+}
+
+// Read one reply line, blocking. Only --list-sessions uses this; terminals
+// talk to the daemon without blocking the UI.
+static char *
+session_read_line(GInputStream *input, GError **error)
+{
+    GString *line = g_string_new(NULL);
+    char c;
+    
+    for (;;) {
+        gssize n = g_input_stream_read(input, &c, 1, NULL, error);
+        if (n <= 0) {
+            if (n == 0)
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "Session daemon closed the connection");
+            g_string_free(line, TRUE);
+            return NULL;
+        }
+        if (c == '\n')
+            return g_string_free(line, FALSE);
+        g_string_append_c(line, c);
+    }
+}
+
+// Encode the visible screen as escape sequences that redraw it, with the
+// cursor in place. Colours are not kept; full-screen programs repaint anyway.
+static GString *
+session_snapshot(VteTerminal *terminal)
+{
+    GString *snapshot = g_string_new("\033[H\033[2J");
+    char *text = vte_terminal_get_text(terminal, NULL, NULL, NULL);
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+    glong column, row;
+    
+    if (text) {
+        char **lines = g_strsplit(g_strchomp(text), "\n", -1);
+        for (int i = 0; lines[i]; i++) {
+            if (i > 0)
+                g_string_append(snapshot, "\r\n");
+            g_string_append(snapshot, g_strchomp(lines[i]));
+        }
+        g_strfreev(lines);
+        g_free(text);
+    }
+    
+    vte_terminal_get_cursor_position(terminal, &column, &row);
+    row -= (glong)gtk_adjustment_get_value(adjustment);
+    g_string_append_printf(snapshot, "\033[%ld;%ldH", MAX(row, 0) + 1, column + 1);
+    return snapshot;
+}
+
+static void
+terminal_session_release(TerminalSession *session)
+{
+    if (session->next_snapshot)
+        g_string_free(session->next_snapshot, TRUE);
+    g_byte_array_unref(session->out);
+    g_object_unref(session->connection);
+    g_free(session);
+}
+
+static void session_flush(TerminalSession *session);
+
+static gboolean
+session_writable(GObject *stream, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)stream;
+    
+    TerminalSession *session = user_data;
+    session->write_source = 0;
+    session_flush(session);
+    return G_SOURCE_REMOVE;
+}
+
+// Write pending messages as far as the socket takes them, then wait for it
+// to drain. Write errors mean the daemon is gone; the PTY keeps working
+// regardless.
+static void
+session_flush(TerminalSession *session)
+{
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(session->connection));
+    GError *error = NULL;
+    
+    if (session->write_source)
+        return;
+    for (;;) {
+        gssize n;
+        
+        if (session->out->len == 0) {
+            if (session->next_snapshot) {
+                g_byte_array_append(session->out, (const guint8 *)session->next_snapshot->str,
+                                    session->next_snapshot->len);
+                g_string_free(session->next_snapshot, TRUE);
+                session->next_snapshot = NULL;
+            } else if (session->close_pending) {
+                g_byte_array_append(session->out, (const guint8 *)"CLOSE\n", 6);
+                session->close_pending = FALSE;
+            } else {
+                break;
+            }
+        }
+        
+        n = g_pollable_output_stream_write_nonblocking(G_POLLABLE_OUTPUT_STREAM(output), session->out->data,
+                                                       session->out->len, NULL, &error);
+        if (n < 0 && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+            GSource *source = g_pollable_output_stream_create_source(G_POLLABLE_OUTPUT_STREAM(output), NULL);
+            g_clear_error(&error);
+            g_source_set_callback(source, G_SOURCE_FUNC(session_writable), session, NULL);
+            session->write_source = g_source_attach(source, NULL);
+            g_source_unref(source);
+            return;
+        }
+        if (n < 0) {
+            g_clear_error(&error);
+            g_byte_array_set_size(session->out, 0);
+            if (session->next_snapshot) {
+                g_string_free(session->next_snapshot, TRUE);
+                session->next_snapshot = NULL;
+            }
+            session->close_pending = FALSE;
+            break;
+        }
+        g_byte_array_remove_range(session->out, 0, n);
+    }
+    if (session->detached)
+        terminal_session_release(session);
+}
+
+static void
+session_send_snapshot(VteTerminal *terminal, TerminalSession *session)
+{
+    GString *snapshot = session_snapshot(terminal);
+    
+    // The daemon would refuse an oversized snapshot, so keep the last one
+    if (snapshot->len <= SESSION_SNAPSHOT_MAX) {
+        char *header = g_strdup_printf("SNAPSHOT %" G_GSIZE_FORMAT "\n", snapshot->len);
+        g_string_prepend(snapshot, header);
+        g_free(header);
+        if (session->next_snapshot)
+            g_string_free(session->next_snapshot, TRUE);
+        session->next_snapshot = snapshot;
+        session_flush(session);
+    } else {
+        g_string_free(snapshot, TRUE);
+    }
+}
+
+static gboolean
+session_snapshot_timeout(gpointer user_data)
+{
+    VteTerminal *terminal = user_data;
+    TerminalSession *session = g_object_get_data(G_OBJECT(terminal), "vyn-session");
+    
+    session->snapshot_source = 0;
+    session_send_snapshot(terminal, session);
+    return G_SOURCE_REMOVE;
+}
+
+// Keep the daemon's snapshot at most a second old, so a crashed frontend
+// still leaves a recent screen behind.
+static void
+on_session_contents_changed(VteTerminal *terminal, gpointer user_data)
+{
+    TerminalSession *session = user_data;
+    if (!session->snapshot_source)
+        session->snapshot_source = g_timeout_add_seconds(1, session_snapshot_timeout, terminal);
+}
+
+static void
+on_session_destroy(GtkWidget *widget, gpointer user_data)
+{
+    TerminalSession *session = user_data;
+    if (!session->killed)
+        session_send_snapshot(VTE_TERMINAL(widget), session);
+}
+
+static void
+on_session_eof(VteTerminal *terminal, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    // The session's shell exited
+    close_terminal(terminal);
+}
+
+// Closing the connection detaches; the daemon keeps the shell running. A
+// last snapshot or CLOSE still being written is finished first.
+static void
+terminal_session_free(gpointer data)
+{
+    TerminalSession *session = data;
+    if (session->snapshot_source)
+        g_source_remove(session->snapshot_source);
+    session->detached = TRUE;
+    if (!session->write_source)
+        terminal_session_release(session);
+}
+
+// Run the terminal's shell on the session PTY, after restoring its screen.
+// Takes the connection and the PTY master. Returns FALSE if the PTY cannot
+// be used.
+static gboolean
+session_attach(VteTerminal *terminal, GSocketConnection *connection, guint id, int fd,
+               const guint8 *screen, gsize length)
+{
+    GError *error = NULL;
+    TerminalSession *session;
+    VtePty *pty;
+    
+    pty = vte_pty_new_foreign_sync(fd, NULL, &error);
+    if (!pty) {
+        g_printerr("Failed to use session PTY: %s\n", error->message);
+        g_error_free(error);
+        close(fd);
+        g_object_unref(connection);
+        return FALSE;
+    }
+    
+    // Restore the screen, then read live output straight from the PTY
+    vte_terminal_feed(terminal, (const char *)screen, length);
+    vte_terminal_set_pty(terminal, pty);
+    g_object_unref(pty);
+    
+    session = g_new0(TerminalSession, 1);
+    session->connection = connection;
+    session->id = id;
+    session->out = g_byte_array_new();
+    g_object_set_data_full(G_OBJECT(terminal), "vyn-session", session, terminal_session_free);
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(on_session_contents_changed), session);
+    g_signal_connect(terminal, "destroy", G_CALLBACK(on_session_destroy), session);
+    g_signal_connect(terminal, "eof", G_CALLBACK(on_session_eof), NULL);
+    return TRUE;
+}
+
+// A terminal waiting for its session. Connecting and the NEW or ATTACH
+// request never block the UI; when the daemon is started for it, the
+// connection is retried from a timeout until the daemon's socket comes up.
+// The reply is an "OK <id> <length>" line, the PTY master, then length
+// bytes that restore the screen.
+typedef struct {
+    VteTerminal *terminal;
+    char *working_directory;
+    guint attach_id;
+    GSocketClient *client;
+    GSocketAddress *address;
+    gboolean spawned;           // The daemon was started for this terminal
+    gint tries;                 // Connection attempts left while it starts
+    GSocketConnection *connection;
+    char *command;
+    GString *line;              // Reply line, read a byte at a time
+    char byte;
+    guint id;
+    int fd;
+    guint8 *screen;
+    gsize length;
+} SessionStart;
+
+static void session_start_connect(SessionStart *start);
+
+static void
+session_start_free(SessionStart *start)
+{
+    if (start->connection)
+        g_object_unref(start->connection);
+    if (start->fd >= 0)
+        close(start->fd);
+    g_free(start->screen);
+    g_string_free(start->line, TRUE);
+    g_free(start->command);
+    g_object_unref(start->address);
+    g_object_unref(start->client);
+    g_free(start->working_directory);
+    g_object_unref(start->terminal);
+    g_free(start);
+}
+
+// Use the session, or fall back to a local shell if it could not be set up.
+static void
+session_start_finish(SessionStart *start, gboolean ready)
+{
+    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(start->terminal));
+    
+    // The terminal was closed meanwhile; dropping the connection detaches
+    if (gtk_widget_is_toplevel(window)) {
+        if (ready) {
+            ready = session_attach(start->terminal, start->connection, start->id, start->fd,
+                                   start->screen, start->length);
+            start->connection = NULL;
+            start->fd = -1;
+        }
+        if (!ready)
+            terminal_start_local(start->terminal, start->working_directory, &window_get_state(window)->settings);
+    }
+    session_start_free(start);
+}
+
+static void
+session_request_failed(SessionStart *start, const char *message)
+{
+    g_printerr("Session request failed: %s\n", message);
+    session_start_finish(start, FALSE);
+}
+
+static void
+session_screen_read(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    SessionStart *start = user_data;
+    GError *error = NULL;
+    gsize bytes_read = 0;
+    
+    if (!g_input_stream_read_all_finish(G_INPUT_STREAM(source), result, &bytes_read, &error)) {
+        session_request_failed(start, error->message);
+        g_error_free(error);
+    } else if (bytes_read < start->length) {
+        session_request_failed(start, "Session daemon closed the connection");
+    } else {
+        session_start_finish(start, TRUE);
+    }
+}
+
+// The PTY master follows the reply line; it has arrived once the socket is
+// readable, so receiving it does not block.
+static gboolean
+session_fd_ready(GSocket *socket, GIOCondition condition, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)socket;
+    (void)condition;
+    
+    SessionStart *start = user_data;
+    GError *error = NULL;
+    
+    start->fd = g_unix_connection_receive_fd(G_UNIX_CONNECTION(start->connection), NULL, &error);
+    if (start->fd < 0) {
+        session_request_failed(start, error->message);
+        g_error_free(error);
+        return G_SOURCE_REMOVE;
+    }
+    start->screen = g_malloc(MAX(start->length, 1));
+    g_input_stream_read_all_async(g_io_stream_get_input_stream(G_IO_STREAM(start->connection)),
+                                  start->screen, start->length, G_PRIORITY_DEFAULT, NULL,
+                                  session_screen_read, start);
+    return G_SOURCE_REMOVE;
+}
+
+static void session_read_reply(SessionStart *start);
+
+// The reply line is read without buffering past it, so the file descriptor
+// that follows stays in the socket for g_unix_connection_receive_fd.
+static void
+session_reply_byte(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    SessionStart *start = user_data;
+    GError *error = NULL;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), result, &error);
+    GSource *fd_source;
+    
+    if (n <= 0) {
+        session_request_failed(start, error ? error->message : "Session daemon closed the connection");
+        g_clear_error(&error);
+        return;
+    }
+    if (start->byte != '\n') {
+        g_string_append_c(start->line, start->byte);
+        if (start->line->len > 4096)
+            session_request_failed(start, "Reply line too long");
+        else
+            session_read_reply(start);
+        return;
+    }
+    
+    if (sscanf(start->line->str, "OK %u %" G_GSIZE_FORMAT, &start->id, &start->length) != 2) {
+        session_request_failed(start, g_str_has_prefix(start->line->str, "ERR ") ? start->line->str + 4
+                                                                                 : start->line->str);
+        return;
+    }
+    // The daemon sends at most a full snapshot and backlog
+    if (start->length > SESSION_SNAPSHOT_MAX + SESSION_BACKLOG_MAX) {
+        session_request_failed(start, "Screen too large");
+        return;
+    }
+    fd_source = g_socket_create_source(g_socket_connection_get_socket(start->connection), G_IO_IN, NULL);
+    g_source_set_callback(fd_source, G_SOURCE_FUNC(session_fd_ready), start, NULL);
+    g_source_attach(fd_source, NULL);
+    g_source_unref(fd_source);
+}
+
+static void
+session_read_reply(SessionStart *start)
+{
+    g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(start->connection)), &start->byte, 1,
+                              G_PRIORITY_DEFAULT, NULL, session_reply_byte, start);
+}
+
+static void
+session_request_sent(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    SessionStart *start = user_data;
+    GError *error = NULL;
+    
+    if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, &error)) {
+        session_request_failed(start, error->message);
+        g_error_free(error);
+        return;
+    }
+    session_read_reply(start);
+}
+
+// Send NEW, or ATTACH for an existing session, over the new connection.
+static void
+session_request(SessionStart *start)
+{
+    if (start->attach_id)
+        start->command = g_strdup_printf("ATTACH %u\n", start->attach_id);
+    else
+        start->command = g_strdup_printf("NEW %ld %ld %s\n", vte_terminal_get_column_count(start->terminal),
+                                         vte_terminal_get_row_count(start->terminal),
+                                         start->working_directory ? start->working_directory : g_get_home_dir());
+    g_output_stream_write_all_async(g_io_stream_get_output_stream(G_IO_STREAM(start->connection)),
+                                    start->command, strlen(start->command), G_PRIORITY_DEFAULT, NULL,
+                                    session_request_sent, start);
+}
+
+static gboolean
+session_start_retry(gpointer user_data)
+{
+    session_start_connect(user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+session_start_connected(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    SessionStart *start = user_data;
+    GError *error = NULL;
+    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(start->terminal));
+    
+    start->connection = g_socket_client_connect_finish(G_SOCKET_CLIENT(source), result, &error);
+    
+    // The terminal was closed while connecting
+    if (!gtk_widget_is_toplevel(window)) {
+        g_clear_error(&error);
+        session_start_free(start);
+        return;
+    }
+    
+    if (!start->connection) {
+        if (start->attach_id == 0 && !start->spawned) {
+            g_clear_error(&error);
+            start->spawned = session_daemon_spawn(&error);
+            start->tries = SESSION_CONNECT_TRIES;
+        }
+        if (start->spawned && start->tries-- > 0) {
+            g_clear_error(&error);
+            g_timeout_add(SESSION_CONNECT_INTERVAL, session_start_retry, start);
+            return;
+        }
+        g_printerr("Session daemon unavailable: %s\n", error->message);
+        g_error_free(error);
+        session_start_finish(start, FALSE);
+        return;
+    }
+    session_request(start);
+}
+
+static void
+session_start_connect(SessionStart *start)
+{
+    g_socket_client_connect_async(start->client, G_SOCKET_CONNECTABLE(start->address), NULL,
+                                  session_start_connected, start);
+}
+
+// Start the terminal's shell in the session daemon, starting the daemon for
+// new sessions if needed. Falls back to a local shell if it cannot be used.
+static void
+session_start(VteTerminal *terminal, const char *working_directory, guint attach_id)
+{
+    SessionStart *start = g_new0(SessionStart, 1);
+    char *path = session_socket_path();
+    
+    start->terminal = g_object_ref(terminal);
+    start->working_directory = g_strdup(working_directory);
+    start->attach_id = attach_id;
+    start->line = g_string_new(NULL);
+    start->fd = -1;
+    start->client = g_socket_client_new();
+    start->address = g_unix_socket_address_new(path);
+    g_free(path);
+    session_start_connect(start);
+}
+
+// Hang up a session shell instead of leaving it detached.
+static void
+session_kill(VteTerminal *terminal)
+{
+    TerminalSession *session = g_object_get_data(G_OBJECT(terminal), "vyn-session");
+    
+    if (!session)
+        return;
+    session->killed = TRUE;
+    session->close_pending = TRUE;
+    session_flush(session);
+}
+
+// Take the text of a pending lazy copy from the terminal's selection.
+static void
+copy_materialize(VteTerminal *terminal)
+{
+    ClipboardCopy *copy = g_object_get_data(G_OBJECT(terminal), "vyn-copy");
+    
+    if (!copy)
+        return;
+#if VTE_CHECK_VERSION(0, 70, 0)
+    copy->text = vte_terminal_get_text_selected(terminal, VTE_FORMAT_TEXT);
+#endif
+    if (!copy->text)
+        copy->text = g_strdup("");
+    g_object_set_data(G_OBJECT(terminal), "vyn-copy", NULL);
+}
+
+static void
+copy_get(GtkClipboard *clipboard, GtkSelectionData *selection_data, guint info, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)clipboard;
+    (void)info;
+    
+    ClipboardCopy *copy = user_data;
+    VteTerminal *terminal = g_weak_ref_get(&copy->terminal);
+    
+    if (terminal) {
+        copy_materialize(terminal);
+        g_object_unref(terminal);
+    }
+    gtk_selection_data_set_text(selection_data, copy->text ? copy->text : "", -1);
+}
+
+static void
+copy_clear(GtkClipboard *clipboard, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)clipboard;
+    
+    ClipboardCopy *copy = user_data;
+    VteTerminal *terminal = g_weak_ref_get(&copy->terminal);
+    
+    if (terminal) {
+        if (g_object_get_data(G_OBJECT(terminal), "vyn-copy") == copy)
+            g_object_set_data(G_OBJECT(terminal), "vyn-copy", NULL);
+        g_object_unref(terminal);
+    }
+    g_weak_ref_clear(&copy->terminal);
+    g_free(copy->text);
+    g_free(copy);
+}
+
+static void
+on_copy_terminal_destroy(GtkWidget *widget, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    copy_materialize(VTE_TERMINAL(widget));
+}
+
+// Copy the selection to the clipboard. Only terminals whose PTY we read can
+// copy lazily: we see their output before VTE does, and output is what
+// clears a selection behind our back. The others copy right away.
+static void
+terminal_copy(VteTerminal *terminal)
+{
+    GtkClipboard *clipboard = gtk_widget_get_clipboard(GTK_WIDGET(terminal), GDK_SELECTION_CLIPBOARD);
+    GtkTargetList *list;
+    GtkTargetEntry *targets;
+    ClipboardCopy *copy;
+    gint n_targets;
+    
+    if (!vte_terminal_get_has_selection(terminal))
+        return;
+    if (!VTE_CHECK_VERSION(0, 70, 0) || !g_object_get_data(G_OBJECT(terminal), "vyn-tap")) {
+        vte_terminal_copy_clipboard_format(terminal, VTE_FORMAT_TEXT);
+        return;
+    }
+    
+    list = gtk_target_list_new(NULL, 0);
+    gtk_target_list_add_text_targets(list, 0);
+    targets = gtk_target_table_new_from_list(list, &n_targets);
+    copy = g_new0(ClipboardCopy, 1);
+    g_weak_ref_init(&copy->terminal, terminal);
+    if (gtk_clipboard_set_with_data(clipboard, targets, n_targets, copy_get, copy_clear, copy)) {
+        g_object_set_data(G_OBJECT(terminal), "vyn-copy", copy);
+        // Let a clipboard manager take the text when we exit
+        gtk_clipboard_set_can_store(clipboard, NULL, 0);
+    } else {
+        copy_clear(clipboard, copy);
+    }
+    gtk_target_table_free(targets, n_targets);
+    gtk_target_list_unref(list);
+}
+
+// The PTY input side of a terminal, or -1 once its shell is gone.
+static int
+terminal_input_fd(VteTerminal *terminal)
+{
+    OutputTap *tap = g_object_get_data(G_OBJECT(terminal), "vyn-tap");
+    VtePty *pty = tap ? tap->pty : vte_terminal_get_pty(terminal);
+    return pty ? vte_pty_get_fd(pty) : -1;
+}
+
+
+static void
+paste_finish(TerminalWindow *state)
+{
+    PasteJob *job = state->paste;
+    
+    if (job->write_source)
+        g_source_remove(job->write_source);
+    g_signal_handler_disconnect(job->terminal, job->destroy_handler);
+    g_byte_array_unref(job->out);
+    g_free(job->text);
+    g_free(job);
+    state->paste = NULL;
+    gtk_widget_hide(state->paste_bar);
+}
+
+// Stop reading the paste. Text already converted is dropped. Once the
+// opening bracket has reached the program, the rest of it and the closing
+// bracket are still sent so the program leaves paste mode.
+static void
+paste_cancel(TerminalWindow *state)
+{
+    PasteJob *job = state->paste;
+    
+    if (!job)
+        return;
+    job->offset = job->length;
+    if (job->bracketed && job->sent > 0 && job->sent < 6) {
+        // out still starts with the unsent end of the opening bracket
+        g_byte_array_set_size(job->out, 6 - job->sent);
+    } else {
+        g_byte_array_set_size(job->out, 0);
+        if (job->sent == 0)
+            job->closed = TRUE;  // Nothing was sent, so there is nothing to close
+    }
+    gtk_label_set_text(GTK_LABEL(state->paste_label), "Cancelling paste");
+}
+
+static void
+paste_convert(PasteJob *job)
+{
+    gsize end = MIN(job->length, job->offset + PASTE_CHUNK);
+    
+    for (; job->offset < end; job->offset++) {
+        char c = job->text[job->offset];
+        gboolean cr = c == '\r';
+        
+        if (c == '\n' && job->after_cr) {
+            job->after_cr = FALSE;
+            continue;
+        }
+        job->after_cr = cr;
+        if (c == '\n')
+            c = '\r';
+        else if (c == '\033' && job->bracketed)
+            continue;
+        g_byte_array_append(job->out, (const guint8 *)&c, 1);
+    }
+}
+
+// Paste into a terminal without a tap. Only VTE knows the program's
+// bracketed paste mode there, so VTE gets the whole text in one call and
+// brackets it once; it queues the PTY writes itself without blocking.
+static void
+paste_via_vte(VteTerminal *terminal, const char *text)
+{
+#if VTE_CHECK_VERSION(0, 68, 0)
+    vte_terminal_paste_text(terminal, text);
+#else
+    // Older VTE cannot paste arbitrary text; send newlines as carriage
+    // returns, as its own paste does
+    GString *converted = g_string_sized_new(strlen(text));
+    
+    for (const char *p = text; *p; p++) {
+        if (*p != '\n')
+            g_string_append_c(converted, *p);
+        else if (p == text || p[-1] != '\r')
+            g_string_append_c(converted, '\r');
+    }
+    vte_terminal_feed_child(terminal, converted->str, converted->len);
+    g_string_free(converted, TRUE);
+#endif
+}
+
+// Write the next chunk when the PTY has room. A program that stops reading
+// fills the PTY, and the paste waits for it rather than queueing in memory.
+static gboolean
+paste_write(gint fd, GIOCondition condition, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)condition;
+    
+    TerminalWindow *state = user_data;
+    PasteJob *job = state->paste;
+    gssize n;
+    
+    if (job->out->len == 0) {
+        if (job->offset < job->length) {
+            paste_convert(job);
+        } else if (job->bracketed && !job->closed) {
+            g_byte_array_append(job->out, (const guint8 *)"\033[201~", 6);
+            job->closed = TRUE;
+        } else {
+            job->write_source = 0;
+            paste_finish(state);
+            return G_SOURCE_REMOVE;
+        }
+    }
+    
+    n = write(fd, job->out->data, job->out->len);
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        job->write_source = 0;
+        paste_finish(state);
+        return G_SOURCE_REMOVE;
+    }
+    if (n > 0) {
+        g_byte_array_remove_range(job->out, 0, n);
+        job->sent += n;
+    }
+    if (gtk_widget_get_visible(state->paste_bar))
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(state->paste_progress),
+                                      (gdouble)job->offset / job->length);
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+on_paste_terminal_destroy(GtkWidget *widget, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)widget;
+    
+    paste_finish(user_data);
+}
+
+static void
+paste_received(GtkClipboard *clipboard, const gchar *text, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)clipboard;
+    
+    GWeakRef *ref = user_data;
+    VteTerminal *terminal = g_weak_ref_get(ref);
+    TerminalWindow *state;
+    OutputTap *tap;
+    PasteJob *job;
+    int fd;
+    
+    g_weak_ref_clear(ref);
+    g_free(ref);
+    if (!terminal)
+        return;
+    state = window_get_state(gtk_widget_get_toplevel(GTK_WIDGET(terminal)));
+    tap = g_object_get_data(G_OBJECT(terminal), "vyn-tap");
+    fd = terminal_input_fd(terminal);
+    if (!text || !*text || !state || state->paste || fd < 0) {
+        g_object_unref(terminal);
+        return;
+    }
+    if (!tap) {
+        paste_via_vte(terminal, text);
+        vte_terminal_unselect_all(terminal);
+        g_object_unref(terminal);
+        return;
+    }
+    g_unix_set_fd_nonblocking(fd, TRUE, NULL);
+    
+    job = g_new0(PasteJob, 1);
+    job->terminal = terminal;
+    job->fd = fd;
+    job->text = g_strdup(text);
+    job->length = strlen(text);
+    job->bracketed = tap->bracketed_paste;
+    job->out = g_byte_array_sized_new(PASTE_CHUNK + 6);
+    if (job->bracketed)
+        g_byte_array_append(job->out, (const guint8 *)"\033[200~", 6);
+    job->destroy_handler = g_signal_connect(terminal, "destroy", G_CALLBACK(on_paste_terminal_destroy), state);
+    state->paste = job;
+    
+    if (job->length >= PASTE_PROGRESS_MIN) {
+        char *size = g_format_size(job->length);
+        char *label = g_strdup_printf("Pasting %s (Esc to cancel)", size);
+        gtk_label_set_text(GTK_LABEL(state->paste_label), label);
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(state->paste_progress), 0.0);
+        gtk_widget_show_all(state->paste_bar);
+        g_free(label);
+        g_free(size);
+    }
+    
+    // Below redraws and input, so the window stays responsive while it runs
+    job->write_source = g_unix_fd_add_full(G_PRIORITY_DEFAULT_IDLE, fd, G_IO_OUT, paste_write, state, NULL);
+    vte_terminal_unselect_all(terminal);
+    g_object_unref(terminal);
+}
+
+// Paste the clipboard. The text arrives asynchronously, so a slow or large
+// clipboard owner does not hold up the window.
+static void
+paste_start(GtkWidget *window, VteTerminal *terminal)
+{
+    GWeakRef *ref;
+    
+    if (window_get_state(window)->paste) {
+        gtk_widget_error_bell(GTK_WIDGET(terminal));
+        return;
+    }
+    ref = g_new0(GWeakRef, 1);
+    g_weak_ref_init(ref, terminal);
+    gtk_clipboard_request_text(gtk_widget_get_clipboard(GTK_WIDGET(terminal), GDK_SELECTION_CLIPBOARD),
+                               paste_received, ref);
+}
+
+static void
+on_paste_bar_response(GtkInfoBar *bar, gint response, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)bar;
+    (void)response;
+    
+    paste_cancel(user_data);
+}
+
+static void
+search_set_terminal(TerminalWindow *state, VteTerminal *terminal)
+{
+    if (state->search_terminal)
+        g_object_remove_weak_pointer(G_OBJECT(state->search_terminal), (gpointer *)&state->search_terminal);
+    state->search_terminal = terminal;
+    if (terminal)
+        g_object_add_weak_pointer(G_OBJECT(terminal), (gpointer *)&state->search_terminal);
+}
+
+// Compile the search entry into a regex on the searched terminal and jump to
+// the newest match. GtkSearchEntry already debounces typing, and the pattern
+// is JIT compiled, so each step stays cheap on large histories.
+static void
+search_update(TerminalWindow *state)
+{
+    VteTerminal *terminal = state->search_terminal;
+    const char *text = gtk_entry_get_text(GTK_ENTRY(state->search_entry));
+    GtkStyleContext *style = gtk_widget_get_style_context(state->search_entry);
+    GError *error = NULL;
+    VteRegex *regex;
+    char *pattern;
+    guint32 flags = PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_UCP | PCRE2_MULTILINE;
+    gboolean has_upper = FALSE;
+    
+    gtk_style_context_remove_class(style, GTK_STYLE_CLASS_ERROR);
+    if (!terminal)
+        return;
+    
+    if (!*text) {
+        vte_terminal_search_set_regex(terminal, NULL, 0);
+        vte_terminal_unselect_all(terminal);
+        return;
+    }
+    
+    // Smart case: lowercase patterns match either case
+    for (const char *c = text; *c; c = g_utf8_next_char(c)) {
+        if (g_unichar_isupper(g_utf8_get_char(c))) {
+            has_upper = TRUE;
+            break;
+        }
+    }
+    if (!has_upper)
+        flags |= PCRE2_CASELESS;
+    
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(state->search_regex)))
+        pattern = g_strdup(text);
+    else
+        pattern = g_regex_escape_string(text, -1);
+    
+    regex = vte_regex_new_for_search(pattern, -1, flags, &error);
+    g_free(pattern);
+    if (!regex) {
+        gtk_style_context_add_class(style, GTK_STYLE_CLASS_ERROR);
+        g_error_free(error);
+        return;
+    }
+    vte_regex_jit(regex, PCRE2_JIT_COMPLETE, NULL);
+    
+    vte_terminal_search_set_regex(terminal, regex, 0);
+    vte_regex_unref(regex);
+    vte_terminal_unselect_all(terminal);
+    if (!vte_terminal_search_find_previous(terminal))
+        gtk_style_context_add_class(style, GTK_STYLE_CLASS_ERROR);
+}
+
+static void
+search_step(TerminalWindow *state, gboolean backward)
+{
+    VteTerminal *terminal = state->search_terminal;
+    if (!terminal || !vte_terminal_search_get_regex(terminal))
+        return;
+    
+    if (backward)
+        vte_terminal_search_find_previous(terminal);
+    else
+        vte_terminal_search_find_next(terminal);
+}
+
+static void
+on_search_changed(GtkSearchEntry *entry, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)entry;
+    
+    search_update(user_data);
+}
+
+static void
+on_search_regex_toggled(GtkToggleButton *button, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)button;
+    
+    search_update(user_data);
+}
+
+static void
+on_search_activate(GtkEntry *entry, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)entry;
+    
+    // Enter walks back through history towards older matches
+    search_step(user_data, TRUE);
+}
+
+static gboolean
+on_search_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)widget;
+    
+    TerminalWindow *state = user_data;
+    guint state_mask = event->state & gtk_accelerator_get_default_mod_mask();
+    
+    // Shift+Enter goes towards newer matches
+    if ((event->keyval == GDK_KEY_Return || event->keyval == GDK_KEY_KP_Enter) &&
+        state_mask == GDK_SHIFT_MASK) {
+        search_step(state, FALSE);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+on_search_mode_changed(GObject *search_bar, GParamSpec *pspec, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)pspec;
+    
+    TerminalWindow *state = user_data;
+    if (gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(search_bar)))
+        return;
+    
+    // Closing the bar clears the search and returns focus to the terminal
+    if (state->search_terminal) {
+        vte_terminal_search_set_regex(state->search_terminal, NULL, 0);
+        vte_terminal_unselect_all(state->search_terminal);
+        gtk_widget_grab_focus(GTK_WIDGET(state->search_terminal));
+    }
+    search_set_terminal(state, NULL);
+}
+
+// Open the search bar over the given terminal's history.
+static void
+search_start(GtkWidget *window, VteTerminal *terminal)
+{
+    TerminalWindow *state = window_get_state(window);
+    
+    // Searching moves the selection
+    copy_materialize(terminal);
+    search_set_terminal(state, terminal);
+    gtk_search_bar_set_search_mode(GTK_SEARCH_BAR(state->search_bar), TRUE);
+    gtk_widget_grab_focus(state->search_entry);
+    search_update(state);
+}
+
+static gboolean
+on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    VteTerminal *terminal = VTE_TERMINAL(widget);
+    GtkWidget *window = gtk_widget_get_toplevel(widget);
+    guint state = event->state & gtk_accelerator_get_default_mod_mask();
+    PasteJob *paste = window_get_state(window)->paste;
+    
+    // Escape cancels a paste into this terminal
+    if (paste && paste->terminal == terminal && event->keyval == GDK_KEY_Escape && state == 0) {
+        paste_cancel(window_get_state(window));
+        return TRUE;
+    }
+    
+    // Ctrl+PageUp and Ctrl+PageDown switch tabs
+    if (state == GDK_CONTROL_MASK &&
+        (event->keyval == GDK_KEY_Page_Up || event->keyval == GDK_KEY_Page_Down)) {
+        GtkNotebook *notebook = window_get_notebook(window);
+        if (event->keyval == GDK_KEY_Page_Up)
+            gtk_notebook_prev_page(notebook);
+        else
+            gtk_notebook_next_page(notebook);
+        return TRUE;
+    }
+    
+    if (state != (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) {
+        latency_key_pressed(window, event);
+        return FALSE;
+    }
+    
+    // Shift turns letters uppercase, so compare against lowercase keyvals
+    switch (gdk_keyval_to_lower(event->keyval)) {
+    case GDK_KEY_c:
+        // Copy
+        terminal_copy(terminal);
+        return TRUE;
+    case GDK_KEY_v:
+        // Paste
+        paste_start(window, terminal);
+        return TRUE;
+    case GDK_KEY_f:
+        // Search scrollback
+        search_start(window, terminal);
+        return TRUE;
+    case GDK_KEY_l:
+        // Toggle output logging
+        tap_toggle_logging(terminal);
+        return TRUE;
+    case GDK_KEY_t: {
+        // New tab in the current directory
+        char *directory = terminal_get_directory(terminal);
+        add_tab(window, directory, 0);
+        g_free(directory);
+        return TRUE;
+    }
+    case GDK_KEY_n: {
+        // New window in the current directory
+        char *directory = terminal_get_directory(terminal);
+        create_window(gtk_window_get_application(GTK_WINDOW(window)), directory,
+                      &window_get_state(window)->settings, 0);
+        g_free(directory);
+        return TRUE;
+    }
+    case GDK_KEY_e:
+        // Split side by side
+        split_terminal(terminal, GTK_ORIENTATION_HORIZONTAL);
+        return TRUE;
+    case GDK_KEY_o:
+        // Split stacked
+        split_terminal(terminal, GTK_ORIENTATION_VERTICAL);
+        return TRUE;
+    case GDK_KEY_w:
+        // Close pane; the shell gets SIGHUP when its terminal goes away.
+        // Session shells are hung up explicitly, since closing only detaches.
+        session_kill(terminal);
+        close_terminal(terminal);
+        return TRUE;
+    case GDK_KEY_Left:
+        gtk_widget_child_focus(window, GTK_DIR_LEFT);
+        return TRUE;
+    case GDK_KEY_Right:
+        gtk_widget_child_focus(window, GTK_DIR_RIGHT);
+        return TRUE;
+    case GDK_KEY_Up:
+        gtk_widget_child_focus(window, GTK_DIR_UP);
+        return TRUE;
+    case GDK_KEY_Down:
+        gtk_widget_child_focus(window, GTK_DIR_DOWN);
+        return TRUE;
+    }
+    latency_key_pressed(window, event);
+    return FALSE;
+}
+
+static void
+on_terminal_title_changed(VteTerminal *terminal, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    update_titles(terminal);
+}
+
+static gboolean
+on_terminal_focus_in(GtkWidget *widget, GdkEventFocus *event, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)event;
+    (void)user_data;
+    
+    update_titles(VTE_TERMINAL(widget));
+    gtk_window_set_urgency_hint(GTK_WINDOW(gtk_widget_get_toplevel(widget)), FALSE);
+    return FALSE;
+}
+
+// Clicking starts a new selection; runs before VTE handles the click.
+static gboolean
+on_terminal_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)event;
+    (void)user_data;
+    
+    copy_materialize(VTE_TERMINAL(widget));
+    return FALSE;
+}
+
+// Create a configured terminal with no shell yet.
+static VteTerminal *
+new_terminal(void)
+{
+    VteTerminal *terminal;
+    
+    // Create VTE terminal
+    terminal = VTE_TERMINAL(vte_terminal_new());
+    
+    // Set terminal colors and font
+    vte_terminal_set_colors(terminal, &config.foreground, &config.background,
+                            config.palette_size ? config.palette : NULL, config.palette_size);
+    if (config.font)
+        vte_terminal_set_font(terminal, config.font);
+    
+    // Set terminal preferences
+    vte_terminal_set_scrollback_lines(terminal, config.scrollback_lines);
+    vte_terminal_set_scroll_on_output(terminal, FALSE);
+    vte_terminal_set_scroll_on_keystroke(terminal, TRUE);
+    vte_terminal_set_cursor_blink_mode(terminal, VTE_CURSOR_BLINK_ON);
+    vte_terminal_set_cursor_shape(terminal, VTE_CURSOR_SHAPE_BLOCK);
+    vte_terminal_set_mouse_autohide(terminal, TRUE);
+    
+    // Connect signals
+    g_signal_connect(terminal, "key-press-event", G_CALLBACK(on_key_press), NULL);
+    g_signal_connect(terminal, "window-title-changed", G_CALLBACK(on_terminal_title_changed), NULL);
+    g_signal_connect(terminal, "focus-in-event", G_CALLBACK(on_terminal_focus_in), NULL);
+    g_signal_connect(terminal, "button-press-event", G_CALLBACK(on_terminal_button_press), NULL);
+    g_signal_connect(terminal, "child-exited", G_CALLBACK(on_child_exited), NULL);
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(on_contents_changed), NULL);
+    
+    return terminal;
+}
+
+// Start the shell. VTE forks on a worker thread, so this returns at once
+// and the shell loads its rc files while the window is realized.
+static void
+terminal_spawn(VteTerminal *terminal, const char *working_directory)
+{
+    char **command_argv = shell_argv();
+    char **envp = shell_environ();
+    
+    vte_terminal_spawn_async(
+        terminal,
+        VTE_PTY_DEFAULT,
+        working_directory,
+        command_argv,
+        envp,
+        G_SPAWN_SEARCH_PATH,
+        NULL, NULL, // child setup
+        NULL,       // child pid
+        -1,         // timeout
+        NULL,       // cancellable
+        child_ready,
+        NULL        // user data
+    );
+    
+    g_strfreev(command_argv);
+    g_strfreev(envp);
+}
+
+static void
+tap_close_log(OutputTap *tap)
+{
+    if (tap->log) {
+        fclose(tap->log);
+        tap->log = NULL;
+    }
+}
+
+// Move log -> log.1 -> log.2 ..., dropping the oldest beyond log_keep.
+static void
+tap_rotate_log(OutputTap *tap)
+{
+    tap_close_log(tap);
+    for (gint i = config.log_keep; i >= 1; i--) {
+        char *from = i == 1 ? g_strdup(tap->log_path) : g_strdup_printf("%s.%d", tap->log_path, i - 1);
+        char *to = g_strdup_printf("%s.%d", tap->log_path, i);
+        rename(from, to);
+        g_free(from);
+        g_free(to);
+    }
+    if (config.log_keep == 0)
+        unlink(tap->log_path);
+}
+
+// Write the batch to the log in one call. Runs on the worker thread.
+static void
+tap_flush(OutputTap *tap)
+{
+    gint dropped = g_atomic_int_and(&tap->dropped, 0);
+    
+    if (tap->batch->len == 0 && dropped == 0)
+        return;
+    if (tap->log && tap->log_size + tap->batch->len > config.log_max_bytes)
+        tap_rotate_log(tap);
+    if (!tap->log) {
+        char *directory = g_path_get_dirname(tap->log_path);
+        g_mkdir_with_parents(directory, 0700);
+        g_free(directory);
+        tap->log = fopen(tap->log_path, "ab");
+        if (!tap->log) {
+            g_printerr("Failed to open %s: %s\n", tap->log_path, g_strerror(errno));
+            g_atomic_int_set(&tap->logging, FALSE);
+            g_byte_array_set_size(tap->batch, 0);
+            return;
+        }
+        tap->log_size = ftell(tap->log);
+    }
+    
+    if (dropped > 0)
+        tap->log_size += fprintf(tap->log, "\n[vyn-terminal: %d output chunks dropped, log writer fell behind]\n", dropped);
+    fwrite(tap->batch->data, 1, tap->batch->len, tap->log);
+    fflush(tap->log);
+    tap->log_size += tap->batch->len;
+    g_byte_array_set_size(tap->batch, 0);
+}
+
+static gboolean
+trigger_fire(gpointer user_data)
+{
+    TriggerHit *hit = user_data;
+    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(hit->terminal));
+    
+    if (gtk_widget_get_parent(GTK_WIDGET(hit->terminal)) && GTK_IS_WINDOW(window)) {
+        char *title = g_strdup_printf("%s: %s", config.trigger_names[hit->trigger],
+                                      gtk_window_get_title(GTK_WINDOW(window)));
+        GNotification *notification = g_notification_new(title);
+        
+        g_notification_set_body(notification, hit->line);
+        g_application_send_notification(g_application_get_default(), NULL, notification);
+        if (!gtk_window_is_active(GTK_WINDOW(window)))
+            gtk_window_set_urgency_hint(GTK_WINDOW(window), TRUE);
+        g_object_unref(notification);
+        g_free(title);
+    }
+    
+    g_object_unref(hit->terminal);
+    g_free(hit->line);
+    g_free(hit);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+tap_match_line(OutputTap *tap)
+{
+    GMatchInfo *info;
+    char *text;
+    
+    if (tap->line->len == 0)
+        return;
+    text = g_utf8_make_valid(tap->line->str, tap->line->len);
+    g_string_truncate(tap->line, 0);
+    
+    if (g_regex_match(config.triggers, text, 0, &info)) {
+        for (guint i = 0; i < config.n_triggers; i++) {
+            char group[16];
+            gint start = -1;
+            gint64 now;
+            
+            g_snprintf(group, sizeof(group), "t%u", i);
+            if (!g_match_info_fetch_named_pos(info, group, &start, NULL) || start < 0)
+                continue;
+            
+            now = g_get_monotonic_time();
+            if (tap->last_fired[i] == 0 || now - tap->last_fired[i] >= TRIGGER_INTERVAL) {
+                TriggerHit *hit = g_new0(TriggerHit, 1);
+                hit->terminal = g_weak_ref_get(&tap->terminal);
+                hit->trigger = i;
+                hit->line = g_strdup(text);
+                tap->last_fired[i] = now;
+                if (hit->terminal) {
+                    g_idle_add(trigger_fire, hit);
+                } else {
+                    g_free(hit->line);
+                    g_free(hit);
+                }
+            }
+            break;
+        }
+    }
+    g_match_info_free(info);
+    g_free(text);
+}
+
+// Strip escape sequences and split output into lines for the triggers.
+static void
+tap_scan(OutputTap *tap, const guint8 *data, gsize size)
+{
+    for (gsize i = 0; i < size; i++) {
+        guint8 c = data[i];
+        
+        switch (tap->escape) {
+        case ESCAPE_NONE:
+            if (c == 0x1b)
+                tap->escape = ESCAPE_START;
+            else if (c == '\n')
+                tap_match_line(tap);
+            else if ((c >= 0x20 || c == '\t') && tap->line->len < TRIGGER_LINE_MAX)
+                g_string_append_c(tap->line, c);
+            break;
+        case ESCAPE_START:
+            if (c == '[')
+                tap->escape = ESCAPE_CSI;
+            else if (c == ']' || c == 'P' || c == '_' || c == '^')
+                tap->escape = ESCAPE_STRING;
+            else
+                tap->escape = ESCAPE_NONE;
+            break;
+        case ESCAPE_CSI:
+            if (c >= 0x40 && c <= 0x7e)
+                tap->escape = ESCAPE_NONE;
+            break;
+        case ESCAPE_STRING:
+            // OSC and DCS strings end with BEL or ESC backslash
+            if (c == 0x07)
+                tap->escape = ESCAPE_NONE;
+            else if (c == 0x1b)
+                tap->escape = ESCAPE_STRING_END;
+            break;
+        case ESCAPE_STRING_END:
+            tap->escape = ESCAPE_NONE;
+            break;
+        }
+    }
+}
+
+// Running tap workers, so the logs are complete before the process exits
+static GMutex tap_workers_lock;
+static GCond tap_workers_done;
+static guint tap_workers;
+
+static void
+tap_workers_wait(void)
+{
+    g_mutex_lock(&tap_workers_lock);
+    while (tap_workers > 0)
+        g_cond_wait(&tap_workers_done, &tap_workers_lock);
+    g_mutex_unlock(&tap_workers_lock);
+}
+
+static gpointer
+tap_worker(gpointer user_data)
+{
+    OutputTap *tap = user_data;
+    
+    for (;;) {
+        gpointer item = g_async_queue_timeout_pop(tap->chunks, G_USEC_PER_SEC);
+        const guint8 *data;
+        gsize size;
+        
+        if (!item) {
+            // Quiet for a second: write what is batched
+            tap_flush(tap);
+            if (!g_atomic_int_get(&tap->logging))
+                tap_close_log(tap);
+            continue;
+        }
+        if (item == tap)
+            break;
+        
+        data = g_bytes_get_data(item, &size);
+        if (g_atomic_int_get(&tap->logging)) {
+            g_byte_array_append(tap->batch, data, size);
+            if (tap->batch->len >= TAP_FLUSH_BYTES)
+                tap_flush(tap);
+        }
+        if (config.triggers)
+            tap_scan(tap, data, size);
+        g_atomic_int_add(&tap->queued, -(gint)size);
+        g_bytes_unref(item);
+    }
+    
+    tap_flush(tap);
+    tap_close_log(tap);
+    g_async_queue_unref(tap->chunks);
+    g_weak_ref_clear(&tap->terminal);
+    g_free(tap->log_path);
+    g_byte_array_unref(tap->batch);
+    g_string_free(tap->line, TRUE);
+    g_free(tap->last_fired);
+    g_free(tap);
+    
+    g_mutex_lock(&tap_workers_lock);
+    if (--tap_workers == 0)
+        g_cond_signal(&tap_workers_done);
+    g_mutex_unlock(&tap_workers_lock);
+    return NULL;
+}
+
+// Follow the program's bracketed paste mode. Programs set it on its own
+// (CSI ? 2004 h or l), so a sequence split across reads is rare enough to
+// miss.
+static void
+tap_track_modes(OutputTap *tap, const guint8 *data, gsize size)
+{
+    static const char mode[] = "\033[?2004";
+    const guint8 *end = data + size;
+    const guint8 *found;
+    
+    while ((found = memmem(data, end - data, mode, sizeof(mode) - 1))) {
+        data = found + sizeof(mode) - 1;
+        if (data < end && (*data == 'h' || *data == 'l'))
+            tap->bracketed_paste = *data == 'h';
+    }
+}
+
+static gboolean
+tap_read(gint fd, GIOCondition condition, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)condition;
+    
+    VteTerminal *terminal = user_data;
+    OutputTap *tap = g_object_get_data(G_OBJECT(terminal), "vyn-tap");
+    guint8 buffer[65536];
+    gssize n = read(fd, buffer, sizeof(buffer));
+    
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return G_SOURCE_CONTINUE;
+    if (n <= 0) {
+        // The shell hung up; its child watch closes the pane
+        tap->read_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    
+    // Output can clear the selection, so a lazy copy takes its text first
+    copy_materialize(terminal);
+    tap_track_modes(tap, buffer, n);
+    vte_terminal_feed(terminal, (const char *)buffer, n);
+    if (g_atomic_int_get(&tap->logging) || config.triggers) {
+        if (g_atomic_int_get(&tap->queued) + n <= TAP_QUEUE_MAX) {
+            g_atomic_int_add(&tap->queued, (gint)n);
+            g_async_queue_push(tap->chunks, g_bytes_new(buffer, n));
+        } else {
+            g_atomic_int_inc(&tap->dropped);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Write input to the PTY, keeping what it cannot take yet.
+static gboolean
+tap_write(gint fd, GIOCondition condition, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)condition;
+    
+    OutputTap *tap = user_data;
+    gssize n = write(fd, tap->pending_input->data, tap->pending_input->len);
+    
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        g_byte_array_set_size(tap->pending_input, 0);
+    } else if (n > 0) {
+        g_byte_array_remove_range(tap->pending_input, 0, n);
+    }
+    if (tap->pending_input->len > 0)
+        return G_SOURCE_CONTINUE;
+    tap->write_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+static void
+on_tap_commit(VteTerminal *terminal, gchar *text, guint size, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)terminal;
+    
+    OutputTap *tap = user_data;
+    g_byte_array_append(tap->pending_input, (const guint8 *)text, size);
+    // Keystrokes go straight out; a watch only waits out a full PTY
+    if (!tap->write_source && tap_write(vte_pty_get_fd(tap->pty), G_IO_OUT, tap) == G_SOURCE_CONTINUE)
+        tap->write_source = g_unix_fd_add_full(tap->read_priority, vte_pty_get_fd(tap->pty), G_IO_OUT,
+                                               tap_write, tap, NULL);
+}
+
+static void
+on_tap_size_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)allocation;
+    
+    OutputTap *tap = user_data;
+    vte_pty_set_size(tap->pty, vte_terminal_get_row_count(VTE_TERMINAL(widget)),
+                     vte_terminal_get_column_count(VTE_TERMINAL(widget)), NULL);
+}
+
+static void
+tap_child_exited(GPid pid, gint status, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)status;
+    
+    GWeakRef *ref = user_data;
+    VteTerminal *terminal = g_weak_ref_get(ref);
+    
+    g_spawn_close_pid(pid);
+    if (terminal) {
+        close_terminal(terminal);
+        g_object_unref(terminal);
+    }
+    g_weak_ref_clear(ref);
+    g_free(ref);
+}
+
+// Closing the PTY hangs up the shell. The worker writes out what is queued
+// and frees the rest of the tap in the background, so closing a busy
+// terminal never waits for it.
+static void
+tap_free(gpointer data)
+{
+    OutputTap *tap = data;
+    
+    if (tap->read_source)
+        g_source_remove(tap->read_source);
+    if (tap->write_source)
+        g_source_remove(tap->write_source);
+    g_clear_object(&tap->pty);
+    g_byte_array_unref(tap->pending_input);
+    g_async_queue_push(tap->chunks, tap);
+}
+
+// Start the shell on a PTY the terminal reads itself, so output can be
+// logged and matched. Low-latency terminals read it ahead of redraws rather
+// than after them, so an echo is on screen in the next frame even while
+// other terminals are busy. Returns FALSE if the shell could not be started.
+static gboolean
+tap_start(VteTerminal *terminal, const char *working_directory, const WindowSettings *settings)
+{
+    static guint next_id = 1;
+    GError *error = NULL;
+    VtePty *pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, &error);
+    OutputTap *tap;
+    GWeakRef *exit_ref;
+    GDateTime *now;
+    char *dir, *name;
+    GPid pid;
+    
+    if (pty) {
+        vte_pty_set_size(pty, vte_terminal_get_row_count(terminal),
+                         vte_terminal_get_column_count(terminal), NULL);
+        if (!spawn_on_pty(pty, working_directory, &pid, &error))
+            g_clear_object(&pty);
+    }
+    if (!pty) {
+        g_printerr("Error launching shell: %s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    
+    tap = g_new0(OutputTap, 1);
+    tap->pty = pty;
+    tap->pending_input = g_byte_array_new();
+    tap->chunks = g_async_queue_new_full((GDestroyNotify)g_bytes_unref);
+    g_weak_ref_init(&tap->terminal, terminal);
+    tap->logging = settings->log_output;
+    tap->read_priority = settings->low_latency ? G_PRIORITY_DEFAULT : G_PRIORITY_DEFAULT_IDLE;
+    tap->batch = g_byte_array_sized_new(TAP_FLUSH_BYTES);
+    tap->line = g_string_new(NULL);
+    tap->last_fired = g_new0(gint64, MAX(config.n_triggers, 1));
+    
+    now = g_date_time_new_now_local();
+    name = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    dir = config.log_dir ? g_strdup(config.log_dir)
+                         : g_build_filename(g_get_user_cache_dir(), "vyn-terminal", "logs", NULL);
+    tap->log_path = g_strdup_printf("%s/vyn-terminal-%s-%d-%u.log", dir, name, getpid(), next_id++);
+    g_free(dir);
+    g_free(name);
+    g_date_time_unref(now);
+    
+    g_mutex_lock(&tap_workers_lock);
+    tap_workers++;
+    g_mutex_unlock(&tap_workers_lock);
+    g_thread_unref(g_thread_new("vyn-tap", tap_worker, tap));
+    g_object_set_data_full(G_OBJECT(terminal), "vyn-tap", tap, tap_free);
+    
+    tap->read_source = g_unix_fd_add_full(tap->read_priority, vte_pty_get_fd(pty),
+                                          G_IO_IN | G_IO_HUP | G_IO_ERR, tap_read, terminal, NULL);
+    g_signal_connect(terminal, "commit", G_CALLBACK(on_tap_commit), tap);
+    g_signal_connect(terminal, "destroy", G_CALLBACK(on_copy_terminal_destroy), NULL);
+    g_signal_connect_after(terminal, "size-allocate", G_CALLBACK(on_tap_size_allocate), tap);
+    
+    exit_ref = g_new0(GWeakRef, 1);
+    g_weak_ref_init(exit_ref, terminal);
+    g_child_watch_add(pid, tap_child_exited, exit_ref);
+    
+    if (tap->logging)
+        g_print("Logging terminal output to %s\n", tap->log_path);
+    return TRUE;
+}
+
+// Start or stop writing a tapped terminal's output to its log.
+static void
+tap_toggle_logging(VteTerminal *terminal)
+{
+    OutputTap *tap = g_object_get_data(G_OBJECT(terminal), "vyn-tap");
+    
+    if (!tap) {
+        g_printerr("Output logging needs log_dir or a trigger in the config, or --log\n");
+        return;
+    }
+    if (!g_atomic_int_get(&tap->logging)) {
+        g_atomic_int_set(&tap->logging, TRUE);
+        g_print("Logging terminal output to %s\n", tap->log_path);
+    } else {
+        g_atomic_int_set(&tap->logging, FALSE);
+        g_print("Stopped logging to %s\n", tap->log_path);
+    }
+}
+
+// Directory prewarmed shells start in
+static const char *
+pool_directory(void)
+{
+    return config.cwd ? config.cwd : g_get_home_dir();
+}
+
+// Top the pool up one shell per idle pass, so prewarming never competes
+// with a window that is starting up.
+static gboolean
+pool_refill(gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
+    
+    VteTerminal *terminal;
+    
+    if (shell_pool.length >= (guint)config.prewarm) {
+        pool_refill_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    
+    terminal = g_object_ref_sink(new_terminal());
+    g_object_set_data(G_OBJECT(terminal), "vyn-prewarmed", GINT_TO_POINTER(TRUE));
+    terminal_spawn(terminal, pool_directory());
+    g_queue_push_tail(&shell_pool, terminal);
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+pool_schedule_refill(void)
+{
+    if (config.prewarm > 0 && !pool_refill_source)
+        pool_refill_source = g_idle_add_full(G_PRIORITY_LOW, pool_refill, NULL, NULL);
+}
+
+// Take a prewarmed terminal if one started where the new shell should.
+static VteTerminal *
+pool_take(const char *working_directory)
+{
+    VteTerminal *terminal;
+    
+    if (working_directory && g_strcmp0(working_directory, pool_directory()) != 0)
+        return NULL;
+    terminal = g_queue_pop_head(&shell_pool);
+    if (terminal)
+        pool_schedule_refill();
+    return terminal;
+}
+
+// Start a shell owned by this process, tapped if the window asks for it.
+static void
+terminal_start_local(VteTerminal *terminal, const char *working_directory, const WindowSettings *settings)
+{
+    if (!settings->tap_output || !tap_start(terminal, working_directory, settings))
+        terminal_spawn(terminal, working_directory);
+}
+
+// Create a terminal in its own scrolled pane and start a shell in it.
+static GtkWidget *
+create_terminal(GtkWidget *window, const char *working_directory, guint attach_id)
+{
+    TerminalWindow *state = window_get_state(window);
+    GtkWidget *scrolled_window;
+    VteTerminal *terminal = NULL;
+    
+    // Session and tapped shells need their own PTY set-up, so only plain
+    // local shells are pooled
+    if (!state->settings.use_sessions && !state->settings.tap_output)
+        terminal = pool_take(working_directory);
+    if (!terminal)
+        terminal = g_object_ref_sink(new_terminal());
+    vte_terminal_set_scrollback_lines(terminal, state->settings.scrollback_lines);
+    if (state->settings.low_latency)
+        vte_terminal_set_cursor_blink_mode(terminal, VTE_CURSOR_BLINK_OFF);
+    
+    // Create scrolled window for terminal
+    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), GTK_WIDGET(terminal));
+    if (state->settings.low_latency) {
+        // Scroll in whole steps, without animated or overlay scrollbars
+        gtk_scrolled_window_set_kinetic_scrolling(GTK_SCROLLED_WINDOW(scrolled_window), FALSE);
+        gtk_scrolled_window_set_overlay_scrolling(GTK_SCROLLED_WINDOW(scrolled_window), FALSE);
+    }
+    
+    // Session shells outlive the window; session_start falls back to a local
+    // shell if the daemon is unavailable
+    if (g_object_get_data(G_OBJECT(terminal), "vyn-prewarmed")) {
+        // Already running
+    } else if (state->settings.use_sessions) {
+        session_start(terminal, working_directory, attach_id);
+    } else {
+        terminal_start_local(terminal, working_directory, &state->settings);
+    }
+    g_object_unref(terminal);
+    
+    return scrolled_window;
+}
+
+static void
+add_tab(GtkWidget *window, const char *working_directory, guint attach_id)
+{
+    GtkNotebook *notebook = window_get_notebook(window);
+    GtkWidget *pane = create_terminal(window, working_directory, attach_id);
+    gint index;
+    
+    index = gtk_notebook_append_page(notebook, pane, gtk_label_new("Terminal"));
+    gtk_notebook_set_tab_reorderable(notebook, pane, TRUE);
+    gtk_widget_show_all(pane);
+    gtk_notebook_set_current_page(notebook, index);
+    gtk_widget_grab_focus(GTK_WIDGET(find_terminal(pane)));
+}
+
+static void
+on_switch_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)notebook;
+    (void)page_num;
+    (void)user_data;
+    
+    // Move focus into the new tab; paneds remember their last focused pane
+    GtkWidget *focus = gtk_window_get_focus(GTK_WINDOW(gtk_widget_get_toplevel(page)));
+    if (!focus || !gtk_widget_is_ancestor(focus, page))
+        gtk_widget_child_focus(page, GTK_DIR_TAB_FORWARD);
+}
+
+static void
+on_pages_changed(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)child;
+    (void)page_num;
+    (void)user_data;
+    
+    // Only show the tab bar when there is more than one tab
+    gtk_notebook_set_show_tabs(notebook, gtk_notebook_get_n_pages(notebook) > 1);
+}
+
+static GtkWidget *
+create_window(GtkApplication *app, const char *working_directory,
+              const WindowSettings *settings, guint attach_id)
+{
+    GtkWidget *window, *notebook, *box, *search_box;
+    TerminalWindow *state = g_new0(TerminalWindow, 1);
+    
+    // Create window
+    window = gtk_application_window_new(app);
+    gtk_window_set_title(GTK_WINDOW(window), "Vyn Terminal");
+    gtk_window_set_default_size(GTK_WINDOW(window), 800, 600);
+    state->settings = *settings;
+    g_object_set_data_full(G_OBJECT(window), "vyn-window", state, terminal_window_free);
+    if (settings->measure_latency) {
+        state->latency = g_new0(LatencyProbe, 1);
+        state->latency->frames = g_array_new(FALSE, FALSE, sizeof(LatencyFrame));
+        state->latency->samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+        g_signal_connect(window, "realize", G_CALLBACK(on_latency_realize), NULL);
+    }
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+    gtk_container_add(GTK_CONTAINER(window), box);
+    
+    // Create search bar
+    state->search_entry = gtk_search_entry_new();
+    gtk_entry_set_width_chars(GTK_ENTRY(state->search_entry), 40);
+    state->search_regex = gtk_check_button_new_with_label("Regex");
+    search_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_box_pack_start(GTK_BOX(search_box), state->search_entry, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(search_box), state->search_regex, FALSE, FALSE, 0);
+    state->search_bar = gtk_search_bar_new();
+    gtk_search_bar_set_show_close_button(GTK_SEARCH_BAR(state->search_bar), TRUE);
+    gtk_search_bar_connect_entry(GTK_SEARCH_BAR(state->search_bar), GTK_ENTRY(state->search_entry));
+    gtk_container_add(GTK_CONTAINER(state->search_bar), search_box);
+    g_signal_connect(state->search_entry, "search-changed", G_CALLBACK(on_search_changed), state);
+    g_signal_connect(state->search_entry, "activate", G_CALLBACK(on_search_activate), state);
+    g_signal_connect(state->search_entry, "key-press-event", G_CALLBACK(on_search_key_press), state);
+    g_signal_connect(state->search_regex, "toggled", G_CALLBACK(on_search_regex_toggled), state);
+    g_signal_connect(state->search_bar, "notify::search-mode-enabled", G_CALLBACK(on_search_mode_changed), state);
+    gtk_box_pack_start(GTK_BOX(box), state->search_bar, FALSE, FALSE, 0);
+    
+    // Create tab container
+    notebook = gtk_notebook_new();
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
+    gtk_notebook_set_show_border(GTK_NOTEBOOK(notebook), FALSE);
+    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
+    gtk_widget_set_can_focus(notebook, FALSE);
+    g_signal_connect_after(notebook, "switch-page", G_CALLBACK(on_switch_page), NULL);
+    g_signal_connect(notebook, "page-added", G_CALLBACK(on_pages_changed), NULL);
+    g_signal_connect(notebook, "page-removed", G_CALLBACK(on_pages_changed), NULL);
+    state->notebook = notebook;
+    gtk_box_pack_start(GTK_BOX(box), notebook, TRUE, TRUE, 0);
+    
+    // Create paste progress bar, shown only during long pastes
+    state->paste_bar = gtk_info_bar_new_with_buttons("_Cancel", GTK_RESPONSE_CANCEL, NULL);
+    state->paste_label = gtk_label_new(NULL);
+    state->paste_progress = gtk_progress_bar_new();
+    gtk_widget_set_valign(state->paste_progress, GTK_ALIGN_CENTER);
+    gtk_box_pack_start(GTK_BOX(gtk_info_bar_get_content_area(GTK_INFO_BAR(state->paste_bar))),
+                       state->paste_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(gtk_info_bar_get_content_area(GTK_INFO_BAR(state->paste_bar))),
+                       state->paste_progress, TRUE, TRUE, 0);
+    gtk_widget_set_no_show_all(state->paste_bar, TRUE);
+    g_signal_connect(state->paste_bar, "response", G_CALLBACK(on_paste_bar_response), state);
+    gtk_box_pack_start(GTK_BOX(box), state->paste_bar, FALSE, FALSE, 0);
+    
+    // Start the shell first so it loads while the window is realized
+    add_tab(window, working_directory, attach_id);
+    
+    // Show all widgets
+    gtk_widget_show_all(window);
+    
+    return window;
+}
+
+static void
+bench_generate_ascii(GString *out, gsize size)
+{
+    guint line = 0;
+    while (out->len < size) {
+        g_string_append_printf(out, "%08u ", line);
+        for (guint i = 0; i < 70; i++)
+            g_string_append_c(out, '!' + (line + i) % 94);
+        g_string_append(out, "\r\n");
+        line++;
+    }
+}
+
+static void
+bench_generate_sgr(GString *out, gsize size)
+{
+    guint word = 0;
+    while (out->len < size) {
+        // Every word switches colours and attributes, as in compiler output
+        for (guint i = 0; i < 9; i++, word++) {
+            g_string_append_printf(out, "\033[%s38;5;%um\033[48;5;%umword%03u\033[0m ",
+                                   word % 7 == 0 ? "1;" : (word % 5 == 0 ? "4;" : ""),
+                                   word % 256, (word * 7) % 256, word % 1000);
+        }
+        g_string_append(out, "\r\n");
+    }
+}
+
+static void
+bench_generate_unicode(GString *out, gsize size)
+{
+    static const char *samples[] = {
+        "h\xc3\xa9llo w\xc3\xb6rld ",                                  // Latin-1 accents
+        "\xe6\xbc\xa2\xe5\xad\x97\xe3\x81\xae\xe3\x83\x86\xe3\x82\xb9\xe3\x83\x88 ", // Wide CJK
+        "e\xcc\x81a\xcc\x88o\xcc\x83 ",                               // Combining marks
+        "a\xcc\x81\xcc\xa7\xcc\x8a\xcc\xb1 ",                        // Stacked combining marks
+        "\xf0\x9f\x98\x80\xf0\x9f\x9a\x80 ",                        // Emoji
+        "\xce\x95\xce\xbb\xce\xbb\xce\xb7\xce\xbd\xce\xb9\xce\xba\xce\xac ", // Greek
+        "\xe2\x94\x8c\xe2\x94\x80\xe2\x94\x90\xe2\x94\x82 "      // Box drawing
+    };
+    guint i = 0;
+    while (out->len < size) {
+        for (guint j = 0; j < 6; j++, i++)
+            g_string_append(out, samples[i % G_N_ELEMENTS(samples)]);
+        g_string_append(out, "\r\n");
+    }
+}
+
+static void
+bench_generate_tui(GString *out, gsize size)
+{
+    guint frame = 0;
+    while (out->len < size) {
+        // Full-screen redraw with absolute cursor moves, like top or htop
+        g_string_append(out, "\033[H\033[7m  PID USER      %CPU %MEM COMMAND                                         \033[0m");
+        for (guint row = 2; row <= 24; row++) {
+            guint pid = 1000 + (row * 37 + frame) % 9000;
+            g_string_append_printf(out, "\033[%u;1H\033[3%um%5u vyn      %4.1f %4.1f \033[0mworker-%u\033[K",
+                                   row, 1 + (row + frame) % 7, pid,
+                                   ((row * frame) % 1000) / 10.0, ((row + frame) % 200) / 10.0, pid);
+        }
+        frame++;
+    }
+}
+
+static const BenchWorkload bench_workloads[] = {
+    { "ascii", bench_generate_ascii },
+    { "sgr", bench_generate_sgr },
+    { "unicode", bench_generate_unicode },
+    { "tui", bench_generate_tui }
+};
+
+static gboolean bench_next(gpointer user_data);
+
+// Write the workload to the PTY slave, as a program in the terminal would.
+// Blocks while VTE drains the PTY, which is the backpressure being measured.
+static gpointer
+bench_writer(gpointer user_data)
+{
+    Bench *bench = user_data;
+    const char *data = bench->data->str;
+    gsize remaining = bench->data->len;
+    
+    while (remaining > 0) {
+        gssize written = write(bench->slave_fd, data, MIN(remaining, 65536));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            g_printerr("Benchmark write failed: %s\n", g_strerror(errno));
+            return NULL;
+        }
+        data += written;
+        remaining -= written;
+    }
+    return NULL;
+}
+
+static gboolean
+bench_finish_run(gpointer user_data)
+{
+    Bench *bench = user_data;
+    const BenchWorkload *workload = &bench_workloads[bench->run / 2];
+    gdouble seconds = (bench->end_time - bench->start_time) / (gdouble)G_USEC_PER_SEC;
+    
+    g_thread_join(bench->writer);
+    bench->writer = NULL;
+    vte_terminal_set_pty(bench->terminal, NULL);
+    close(bench->slave_fd);
+    g_clear_object(&bench->pty);
+    
+    g_array_sort(bench->draw_times, compare_doubles);
+    g_print("%-8s %-8s %9.1f %8u %8.1f %8.2f %8.2f\n",
+            workload->name, bench->run % 2 ? "on" : "off",
+            bench->data->len / (1024.0 * 1024.0) / seconds,
+            bench->draw_times->len, bench->draw_times->len / seconds,
+            percentile(bench->draw_times, 0.50), percentile(bench->draw_times, 0.99));
+    
+    bench->run++;
+    g_idle_add(bench_next, bench);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+bench_title_changed(VteTerminal *terminal, gpointer user_data)
+{
+    Bench *bench = user_data;
+    
+    // The marker title is the last thing written, so VTE has parsed everything
+    if (!bench->marker || g_strcmp0(vte_terminal_get_window_title(terminal), bench->marker) != 0)
+        return;
+    bench->end_time = g_get_monotonic_time();
+    g_clear_pointer(&bench->marker, g_free);
+    g_idle_add(bench_finish_run, bench);
+}
+
+static gboolean
+bench_draw_begin(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)widget;
+    (void)cr;
     
-    if (error) {
-        g_printerr("Error launching shell: %s\n", error->message);
+    ((Bench *)user_data)->draw_start = g_get_monotonic_time();
+    return FALSE;
+}
+
+static gboolean
+bench_draw_end(GtkWidget *widget, cairo_t *cr, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)widget;
+    (void)cr;
+    
+    Bench *bench = user_data;
+    if (bench->marker) {
+        gdouble ms = (g_get_monotonic_time() - bench->draw_start) / 1000.0;
+        g_array_append_val(bench->draw_times, ms);
+    }
+    return FALSE;
+}
+
+// Start the next workload on a fresh PTY, or quit when all have run.
+static gboolean
+bench_next(gpointer user_data)
+{
+    Bench *bench = user_data;
+    GError *error = NULL;
+    struct termios attributes;
+    
+    if (bench->run >= 2 * G_N_ELEMENTS(bench_workloads)) {
+        gtk_main_quit();
+        return G_SOURCE_REMOVE;
+    }
+    
+    window_get_state(bench->window)->settings.coalesce_redraws = bench->run % 2;
+    g_string_truncate(bench->data, 0);
+    bench_workloads[bench->run / 2].generate(bench->data, bench->size);
+    bench->marker = g_strdup_printf("vyn-bench-%u", bench->run);
+    g_string_append_printf(bench->data, "\033]2;%s\007", bench->marker);
+    
+    bench->pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, &error);
+    if (!bench->pty) {
+        g_printerr("Failed to open PTY: %s\n", error->message);
         g_error_free(error);
+        bench->status = 1;
+        gtk_main_quit();
+        return G_SOURCE_REMOVE;
+    }
+    bench->slave_fd = open(ptsname(vte_pty_get_fd(bench->pty)), O_RDWR | O_NOCTTY);
+    if (bench->slave_fd < 0) {
+        g_printerr("Failed to open PTY slave: %s\n", g_strerror(errno));
+        g_clear_object(&bench->pty);
+        bench->status = 1;
         gtk_main_quit();
+        return G_SOURCE_REMOVE;
     }
+    // Raw mode, so the line discipline passes the workload through untouched
+    tcgetattr(bench->slave_fd, &attributes);
+    cfmakeraw(&attributes);
+    tcsetattr(bench->slave_fd, TCSANOW, &attributes);
+    
+    vte_terminal_reset(bench->terminal, TRUE, TRUE);
+    vte_terminal_set_pty(bench->terminal, bench->pty);
+    g_array_set_size(bench->draw_times, 0);
+    bench->start_time = g_get_monotonic_time();
+    bench->writer = g_thread_new("vyn-bench-writer", bench_writer, bench);
+    return G_SOURCE_REMOVE;
 }
 
 static gboolean
-on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+bench_mapped(GtkWidget *widget, GdkEvent *event, gpointer user_data)
 {
     // Suppress unused parameter warning
-    (void)user_data;
+    (void)event;
+    
+    g_signal_handlers_disconnect_by_func(widget, G_CALLBACK(bench_mapped), user_data);
+    g_idle_add(bench_next, user_data);
+    return FALSE;
+}
+
+// Feed each workload through a PTY into a terminal in an ordinary window and
+// report throughput and draw times. Run under Xvfb for headless use.
+static int
+bench_run(gint size_mb)
+{
+    Bench bench = { 0 };
+    GdkRGBA bg_color, fg_color;
+    
+    bench.size = (gsize)size_mb * 1024 * 1024;
+    bench.data = g_string_sized_new(bench.size + 4096);
+    bench.draw_times = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    
+    bench.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(bench.window), "Vyn Terminal Benchmark");
+    gtk_window_set_default_size(GTK_WINDOW(bench.window), 800, 600);
+    g_object_set_data_full(G_OBJECT(bench.window), "vyn-window", g_new0(TerminalWindow, 1), terminal_window_free);
+    
+    // Same colours and scrollback as a normal terminal
+    bench.terminal = VTE_TERMINAL(vte_terminal_new());
+    gdk_rgba_parse(&bg_color, "#282828");
+    gdk_rgba_parse(&fg_color, "#F8F8F2");
+    vte_terminal_set_colors(bench.terminal, &fg_color, &bg_color, NULL, 0);
+    vte_terminal_set_scrollback_lines(bench.terminal, DEFAULT_SCROLLBACK_LINES);
+    g_signal_connect(bench.terminal, "contents-changed", G_CALLBACK(on_contents_changed), NULL);
+    g_signal_connect(bench.terminal, "window-title-changed", G_CALLBACK(bench_title_changed), &bench);
+    g_signal_connect(bench.terminal, "draw", G_CALLBACK(bench_draw_begin), &bench);
+    g_signal_connect_after(bench.terminal, "draw", G_CALLBACK(bench_draw_end), &bench);
+    gtk_container_add(GTK_CONTAINER(bench.window), GTK_WIDGET(bench.terminal));
+    
+    g_signal_connect(bench.window, "map-event", G_CALLBACK(bench_mapped), &bench);
+    gtk_widget_show_all(bench.window);
+    
+    g_print("%d MB per workload\n", size_mb);
+    g_print("%-8s %-8s %9s %8s %8s %8s %8s\n",
+            "workload", "coalesce", "MB/s", "frames", "fps", "p50 ms", "p99 ms");
+    gtk_main();
+    
+    gtk_widget_destroy(bench.window);
+    g_string_free(bench.data, TRUE);
+    g_array_free(bench.draw_times, TRUE);
+    return bench.status;
+}
+
+static void daemon_client_read(DaemonClient *client);
+
+static gboolean
+session_read(gint fd, GIOCondition condition, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)condition;
+    
+    Session *session = user_data;
+    guint8 buffer[65536];
+    gssize n = read(fd, buffer, sizeof(buffer));
+    
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return G_SOURCE_CONTINUE;
+    if (n <= 0) {
+        // The shell hung up; the child watch removes the session
+        session->read_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    
+    g_byte_array_append(session->backlog, buffer, n);
+    if (session->backlog->len > SESSION_BACKLOG_MAX) {
+        // The snapshot no longer lines up with the kept output
+        g_byte_array_remove_range(session->backlog, 0, session->backlog->len - SESSION_BACKLOG_MAX);
+        g_byte_array_set_size(session->snapshot, 0);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Drain the PTY while no frontend is attached, so the shell never blocks.
+static void
+session_resume(Session *session)
+{
+    if (!session->read_source && !session->closed)
+        session->read_source = g_unix_fd_add(vte_pty_get_fd(session->pty), G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                              session_read, session);
+}
+
+static void
+session_free(gpointer data)
+{
+    Session *session = data;
+    if (session->read_source)
+        g_source_remove(session->read_source);
+    if (session->client)
+        session->client->session = NULL;
+    g_clear_object(&session->pty);
+    g_byte_array_unref(session->snapshot);
+    g_byte_array_unref(session->backlog);
+    g_free(session);
+}
+
+static void
+session_exited(GPid pid, gint status, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)status;
+    
+    Session *session = user_data;
+    g_spawn_close_pid(pid);
+    g_hash_table_remove(daemon_sessions, GUINT_TO_POINTER(session->id));
+    
+    // The daemon lives as long as it has sessions
+    if (g_hash_table_size(daemon_sessions) == 0)
+        g_main_loop_quit(daemon_loop);
+}
+
+static Session *
+session_spawn(glong columns, glong rows, const char *working_directory, GError **error)
+{
+    VtePty *pty = vte_pty_new_sync(VTE_PTY_DEFAULT, NULL, error);
+    Session *session;
+    GPid pid;
+    
+    if (!pty)
+        return NULL;
+    vte_pty_set_size(pty, rows, columns, NULL);
+    
+    if (!spawn_on_pty(pty, working_directory, &pid, error)) {
+        g_object_unref(pty);
+        return NULL;
+    }
+    
+    session = g_new0(Session, 1);
+    session->id = daemon_next_id++;
+    session->pty = pty;
+    session->pid = pid;
+    session->snapshot = g_byte_array_new();
+    session->backlog = g_byte_array_new();
+    g_hash_table_insert(daemon_sessions, GUINT_TO_POINTER(session->id), session);
+    g_child_watch_add(pid, session_exited, session);
+    return session;
+}
+
+static DaemonClient *
+daemon_client_ref(DaemonClient *client)
+{
+    client->refs++;
+    return client;
+}
+
+static void
+daemon_reply_free(DaemonReply *reply)
+{
+    if (reply->bytes)
+        g_bytes_unref(reply->bytes);
+    else
+        close(reply->fd);
+    g_free(reply);
+}
+
+static void
+daemon_client_unref(DaemonClient *client)
+{
+    if (--client->refs > 0)
+        return;
+    g_queue_clear_full(&client->replies, (GDestroyNotify)daemon_reply_free);
+    g_free(client->snapshot);
+    g_object_unref(client->cancellable);
+    g_object_unref(client->input);
+    g_object_unref(client->connection);
+    g_free(client);
+}
+
+// Forget a frontend that closed, crashed or stopped taking replies, keeping
+// its shell running. Operations in flight finish as cancelled.
+static void
+daemon_client_close(DaemonClient *client)
+{
+    if (client->closed)
+        return;
+    client->closed = TRUE;
+    g_cancellable_cancel(client->cancellable);
+    if (client->session) {
+        client->session->client = NULL;
+        session_resume(client->session);
+        client->session = NULL;
+    }
+    daemon_client_unref(client);
+}
+
+static void daemon_client_flush(DaemonClient *client);
+
+static void
+daemon_client_written(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    DaemonClient *client = user_data;
+    gboolean written = g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, NULL);
+    
+    daemon_reply_free(g_queue_pop_head(&client->replies));
+    client->writing = FALSE;
+    if (written)
+        daemon_client_flush(client);
+    else
+        daemon_client_close(client);
+    daemon_client_unref(client);
+}
+
+static gboolean
+daemon_client_send_fd(GSocket *socket, GIOCondition condition, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)socket;
+    (void)condition;
+    
+    DaemonClient *client = user_data;
+    DaemonReply *reply = g_queue_pop_head(&client->replies);
+    GError *error = NULL;
+    
+    client->writing = FALSE;
+    if (client->closed) {
+        daemon_reply_free(reply);
+    } else if (!g_unix_connection_send_fd(G_UNIX_CONNECTION(client->connection), reply->fd, NULL, &error)) {
+        g_printerr("Failed to pass session PTY: %s\n", error->message);
+        g_error_free(error);
+        daemon_reply_free(reply);
+        daemon_client_close(client);
+    } else {
+        daemon_reply_free(reply);
+        daemon_client_flush(client);
+    }
+    daemon_client_unref(client);
+    return G_SOURCE_REMOVE;
+}
+
+// Write the next queued reply. Bytes go through an async write; a PTY master
+// is passed once the socket is writable, so sending it cannot block either.
+static void
+daemon_client_flush(DaemonClient *client)
+{
+    DaemonReply *reply = g_queue_peek_head(&client->replies);
     
-    // Handle Ctrl+Shift+C and Ctrl+Shift+V for copy-paste
-    if ((event->state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) == (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) {
-        if (event->keyval == GDK_KEY_c) {
-            vte_terminal_copy_clipboard_format(VTE_TERMINAL(widget), VTE_FORMAT_TEXT);
-            return TRUE;
-        } else if (event->keyval == GDK_KEY_v) {
-            vte_terminal_paste_clipboard(VTE_TERMINAL(widget));
-            return TRUE;
+    if (client->writing || client->closed)
+        return;
+    if (!reply) {
+        if (client->read_waiting) {
+            client->read_waiting = FALSE;
+            daemon_client_read(client);
         }
+        return;
+    }
+    
+    client->writing = TRUE;
+    daemon_client_ref(client);
+    if (reply->bytes) {
+        g_output_stream_write_all_async(g_io_stream_get_output_stream(G_IO_STREAM(client->connection)),
+                                        g_bytes_get_data(reply->bytes, NULL), g_bytes_get_size(reply->bytes),
+                                        G_PRIORITY_DEFAULT, client->cancellable, daemon_client_written, client);
+    } else {
+        GSource *source = g_socket_create_source(g_socket_connection_get_socket(client->connection),
+                                                 G_IO_OUT, client->cancellable);
+        g_source_set_callback(source, G_SOURCE_FUNC(daemon_client_send_fd), client, NULL);
+        g_source_attach(source, NULL);
+        g_source_unref(source);
     }
-    return FALSE;
 }
 
 static void
-on_terminal_title_changed(VteTerminal *terminal, gpointer user_data)
+daemon_queue(DaemonClient *client, GBytes *bytes, int fd)
 {
-    GtkWindow *window = GTK_WINDOW(user_data);
-    const char *title = vte_terminal_get_window_title(terminal);
-    if (title) {
-        char *full_title = g_strdup_printf("Vyn Terminal - %s", title);
-        gtk_window_set_title(window, full_title);
-        g_free(full_title);
+    DaemonReply *reply = g_new0(DaemonReply, 1);
+    
+    reply->bytes = bytes;
+    reply->fd = fd;
+    g_queue_push_tail(&client->replies, reply);
+    daemon_client_flush(client);
+}
+
+static void
+daemon_reply(DaemonClient *client, const char *format, ...) G_GNUC_PRINTF(2, 3);
+
+static void
+daemon_reply(DaemonClient *client, const char *format, ...)
+{
+    va_list args;
+    char *text;
+    
+    va_start(args, format);
+    text = g_strdup_vprintf(format, args);
+    va_end(args);
+    daemon_queue(client, g_bytes_new_take(text, strlen(text)), -1);
+}
+
+// Hand the session to the client: a header, the PTY master itself, then the
+// snapshot and backlog that rebuild the current screen. They are queued
+// with copies of their own, so the session is the client's right away.
+static void
+daemon_attach(DaemonClient *client, Session *session)
+{
+    int fd = dup(vte_pty_get_fd(session->pty));
+    
+    if (fd < 0) {
+        daemon_reply(client, "ERR cannot pass PTY: %s\n", g_strerror(errno));
+        return;
+    }
+    daemon_reply(client, "OK %u %u\n", session->id, session->snapshot->len + session->backlog->len);
+    daemon_queue(client, NULL, fd);
+    daemon_queue(client, g_byte_array_free_to_bytes(session->snapshot), -1);
+    daemon_queue(client, g_byte_array_free_to_bytes(session->backlog), -1);
+    session->snapshot = g_byte_array_new();
+    session->backlog = g_byte_array_new();
+    
+    // The frontend reads the PTY from now on
+    if (session->read_source) {
+        g_source_remove(session->read_source);
+        session->read_source = 0;
+    }
+    session->client = client;
+    client->session = session;
+}
+
+// Hang up a session: once the frontend has closed its copy too, the last
+// close of the PTY master hangs up the shell and its foreground job, even
+// ones that ignore SIGHUP, since their terminal reads fail from then on.
+static void
+session_close(Session *session)
+{
+    if (session->read_source) {
+        g_source_remove(session->read_source);
+        session->read_source = 0;
+    }
+    g_clear_object(&session->pty);
+    session->closed = TRUE;
+}
+
+static void
+daemon_snapshot_read(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    DaemonClient *client = user_data;
+    gsize bytes_read = 0;
+    
+    if (!g_input_stream_read_all_finish(G_INPUT_STREAM(source), result, &bytes_read, NULL) ||
+        bytes_read < client->snapshot_length) {
+        daemon_client_close(client);
+    } else if (!client->closed) {
+        if (client->session) {
+            g_byte_array_set_size(client->session->snapshot, 0);
+            g_byte_array_append(client->session->snapshot, client->snapshot, client->snapshot_length);
+        }
+        g_clear_pointer(&client->snapshot, g_free);
+        daemon_client_read(client);
+    }
+    daemon_client_unref(client);
+}
+
+static void
+daemon_snapshot_skipped(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    DaemonClient *client = user_data;
+    gssize skipped = g_input_stream_skip_finish(G_INPUT_STREAM(source), result, NULL);
+    
+    if (skipped <= 0) {
+        daemon_client_close(client);
+    } else if (!client->closed) {
+        client->snapshot_length -= skipped;
+        if (client->snapshot_length > 0)
+            g_input_stream_skip_async(G_INPUT_STREAM(client->input), client->snapshot_length, G_PRIORITY_DEFAULT,
+                                      client->cancellable, daemon_snapshot_skipped, daemon_client_ref(client));
+        else
+            daemon_client_read(client);
+    }
+    daemon_client_unref(client);
+}
+
+// Read a SNAPSHOT payload without blocking the other sessions. Oversized
+// ones are skipped rather than buffered.
+static void
+daemon_read_snapshot(DaemonClient *client, gsize length)
+{
+    client->snapshot_length = length;
+    if (length > SESSION_SNAPSHOT_MAX) {
+        daemon_reply(client, "ERR snapshot too large\n");
+        g_input_stream_skip_async(G_INPUT_STREAM(client->input), length, G_PRIORITY_DEFAULT,
+                                  client->cancellable, daemon_snapshot_skipped, daemon_client_ref(client));
+        return;
+    }
+    client->snapshot = g_malloc(length);
+    g_input_stream_read_all_async(G_INPUT_STREAM(client->input), client->snapshot, length, G_PRIORITY_DEFAULT,
+                                  client->cancellable, daemon_snapshot_read, daemon_client_ref(client));
+}
+
+// Handle one request line. Returns FALSE if the request goes on reading the
+// connection itself.
+static gboolean
+daemon_handle(DaemonClient *client, const char *line)
+{
+    GError *error = NULL;
+    
+    if (g_str_has_prefix(line, "NEW ") && !client->session) {
+        // NEW <columns> <rows> <working directory>
+        char **fields = g_strsplit(line + 4, " ", 3);
+        Session *session = NULL;
+        
+        if (g_strv_length(fields) == 3)
+            session = session_spawn(g_ascii_strtoll(fields[0], NULL, 10),
+                                    g_ascii_strtoll(fields[1], NULL, 10), fields[2], &error);
+        if (session) {
+            daemon_attach(client, session);
+        } else {
+            daemon_reply(client, "ERR %s\n", error ? error->message : "malformed NEW");
+            g_clear_error(&error);
+        }
+        g_strfreev(fields);
+    } else if (g_str_has_prefix(line, "ATTACH ") && !client->session) {
+        guint id = g_ascii_strtoull(line + 7, NULL, 10);
+        Session *session = g_hash_table_lookup(daemon_sessions, GUINT_TO_POINTER(id));
+        
+        if (!session || session->closed)
+            daemon_reply(client, "ERR no session %u\n", id);
+        else if (session->client)
+            daemon_reply(client, "ERR session %u is attached elsewhere\n", id);
+        else
+            daemon_attach(client, session);
+    } else if (g_str_equal(line, "LIST")) {
+        GHashTableIter iter;
+        gpointer value;
+        
+        g_hash_table_iter_init(&iter, daemon_sessions);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            Session *session = value;
+            daemon_reply(client, "%u %d %s\n", session->id, session->pid,
+                         session->closed ? "closing" : session->client ? "attached" : "detached");
+        }
+        daemon_reply(client, "END\n");
+    } else if (g_str_has_prefix(line, "SNAPSHOT ")) {
+        daemon_read_snapshot(client, g_ascii_strtoull(line + 9, NULL, 10));
+        return FALSE;
+    } else if (g_str_equal(line, "CLOSE") && client->session) {
+        session_close(client->session);
     } else {
-        gtk_window_set_title(window, "Vyn Terminal");
+        daemon_reply(client, "ERR unknown request\n");
     }
+    return TRUE;
 }
 
-int
-main(int argc, char *argv[])
+static void
+daemon_client_line(GObject *source, GAsyncResult *result, gpointer user_data)
 {
-    GtkWidget *window, *terminal;
-    GtkWidget *scrolled_window;
-    GdkRGBA bg_color, fg_color;
-    char **command_argv;
-    char *shell;
+    DaemonClient *client = user_data;
+    char *line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source), result, NULL, NULL);
     
-    // Initialize GTK
-    gtk_init(&argc, &argv);
+    if (!line) {
+        // Frontend closed or crashed: detach and keep the shell running
+        daemon_client_close(client);
+    } else if (!client->closed && daemon_handle(client, line)) {
+        daemon_client_read(client);
+    }
+    g_free(line);
+    daemon_client_unref(client);
+}
+
+// Read the next request, once the replies to the last one are out.
+static void
+daemon_client_read(DaemonClient *client)
+{
+    if (client->closed)
+        return;
+    if (client->writing || !g_queue_is_empty(&client->replies)) {
+        client->read_waiting = TRUE;
+        return;
+    }
+    g_data_input_stream_read_line_async(client->input, G_PRIORITY_DEFAULT, client->cancellable,
+                                        daemon_client_line, daemon_client_ref(client));
+}
+
+static gboolean
+on_daemon_incoming(GSocketService *service, GSocketConnection *connection,
+                   GObject *source_object, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)service;
+    (void)source_object;
+    (void)user_data;
     
-    // Create window
-    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    gtk_window_set_title(GTK_WINDOW(window), "Vyn Terminal");
-    gtk_window_set_default_size(GTK_WINDOW(window), 800, 600);
-    g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    DaemonClient *client = g_new0(DaemonClient, 1);
+    client->refs = 1;
+    client->cancellable = g_cancellable_new();
+    client->connection = g_object_ref(connection);
+    client->input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    g_queue_init(&client->replies);
+    daemon_client_read(client);
+    return TRUE;
+}
+
+// Session daemon (--daemon). Owns the PTYs of --sessions terminals so their
+// shells survive the frontend closing or crashing. Frontends receive the PTY
+// master over the socket and read it directly while attached.
+static int
+daemon_run(void)
+{
+    GError *error = NULL;
+    char *path = session_socket_path();
+    char *directory = g_path_get_dirname(path);
+    GSocketConnection *existing;
+    GSocketService *service;
+    GSocketAddress *address;
     
-    // Create VTE terminal
-    terminal = vte_terminal_new();
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    config_load();
+    g_mkdir_with_parents(directory, 0700);
+    g_free(directory);
     
-    // Set terminal colors
-    gdk_rgba_parse(&bg_color, "#282828");
-    gdk_rgba_parse(&fg_color, "#F8F8F2");
-    vte_terminal_set_colors(VTE_TERMINAL(terminal), &fg_color, &bg_color, NULL, 0);
+    existing = session_connect(NULL);
+    if (existing) {
+        g_printerr("Session daemon already running\n");
+        g_object_unref(existing);
+        g_free(path);
+        return 0;
+    }
+    unlink(path);  // Left behind by a daemon that did not exit cleanly
     
-    // Set terminal preferences
-    vte_terminal_set_scrollback_lines(VTE_TERMINAL(terminal), 10000);
-    vte_terminal_set_scroll_on_output(VTE_TERMINAL(terminal), FALSE);
-    vte_terminal_set_scroll_on_keystroke(VTE_TERMINAL(terminal), TRUE);
-    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(terminal), VTE_CURSOR_BLINK_ON);
-    vte_terminal_set_cursor_shape(VTE_TERMINAL(terminal), VTE_CURSOR_SHAPE_BLOCK);
-    vte_terminal_set_mouse_autohide(VTE_TERMINAL(terminal), TRUE);
+    service = g_socket_service_new();
+    address = g_unix_socket_address_new(path);
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+                                       G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error)) {
+        g_printerr("Failed to listen on %s: %s\n", path, error->message);
+        g_error_free(error);
+        g_object_unref(address);
+        g_object_unref(service);
+        g_free(path);
+        return 1;
+    }
+    g_object_unref(address);
     
-    // Connect signals
-    g_signal_connect(terminal, "key-press-event", G_CALLBACK(on_key_press), NULL);
-    g_signal_connect(terminal, "window-title-changed", G_CALLBACK(on_terminal_title_changed), window);
+    daemon_sessions = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, session_free);
+    daemon_loop = g_main_loop_new(NULL, FALSE);
+    g_signal_connect(service, "incoming", G_CALLBACK(on_daemon_incoming), NULL);
+    g_socket_service_start(service);
+    g_main_loop_run(daemon_loop);
     
-    // Create scrolled window for terminal
-    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
-    gtk_container_add(GTK_CONTAINER(scrolled_window), terminal);
-    gtk_container_add(GTK_CONTAINER(window), scrolled_window);
+    g_socket_service_stop(service);
+    g_object_unref(service);
+    unlink(path);
+    g_free(path);
+    g_hash_table_destroy(daemon_sessions);
+    g_main_loop_unref(daemon_loop);
+    return 0;
+}
+
+// Print the daemon's sessions for --list-sessions.
+static int
+list_sessions(void)
+{
+    GSocketConnection *connection = session_connect(NULL);
+    GInputStream *input;
+    GOutputStream *output;
+    char *line;
     
-    // Show all widgets
-    gtk_widget_show_all(window);
+    if (!connection) {
+        g_print("No session daemon running\n");
+        return 0;
+    }
+    input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+    output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
     
-    // Start ZSH shell
-    shell = g_strdup("/bin/zsh");
-    if (!g_file_test(shell, G_FILE_TEST_EXISTS)) {
-        g_free(shell);
-        shell = g_strdup("/bin/bash");  // Fallback to bash if zsh is not available
+    g_output_stream_write_all(output, "LIST\n", 5, NULL, NULL, NULL);
+    g_print("%-6s %-8s %s\n", "ID", "PID", "STATE");
+    while ((line = session_read_line(input, NULL)) && !g_str_equal(line, "END")) {
+        guint id;
+        int pid;
+        char state[16];
+        if (sscanf(line, "%u %d %15s", &id, &pid, state) == 3)
+            g_print("%-6u %-8d %s\n", id, pid, state);
+        g_free(line);
     }
+    g_free(line);
+    g_object_unref(connection);
+    return 0;
+}
+
+// --bench, --daemon and --list-sessions run locally instead of being
+// forwarded to a running instance.
+static gint
+on_handle_local_options(GApplication *app, GVariantDict *options, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)app;
+    (void)user_data;
     
-    command_argv = g_new0(char *, 2);
-    command_argv[0] = g_strdup(shell);  // Must duplicate the string
-    command_argv[1] = NULL;
+    gint size_mb = DEFAULT_BENCH_MB;
     
-    vte_terminal_spawn_async(
-        VTE_TERMINAL(terminal),
-        VTE_PTY_DEFAULT,
-        NULL,       // working directory
-        command_argv,
-        NULL,       // environment
-        G_SPAWN_SEARCH_PATH,
-        NULL, NULL, // child setup
-        NULL,       // child pid
-        -1,         // timeout
-        NULL,       // cancellable
-        child_ready,
-        NULL        // user data
-    );
+    // The daemon and session listing run without a display
+    if (g_variant_dict_contains(options, "daemon"))
+        return daemon_run();
+    if (g_variant_dict_contains(options, "list-sessions"))
+        return list_sessions();
+    if (!g_variant_dict_contains(options, "bench"))
+        return -1;
+    
+    g_variant_dict_lookup(options, "bench-size", "i", &size_mb);
+    if (size_mb <= 0) {
+        g_printerr("--bench-size must be positive\n");
+        return 1;
+    }
+    gtk_init(NULL, NULL);
+    return bench_run(size_mb);
+}
+
+// Runs once, in the primary instance only.
+static void
+on_startup(GApplication *app, gpointer user_data)
+{
+    // Suppress unused parameter warnings
+    (void)app;
+    (void)user_data;
+    
+    config_load();
+}
+
+// Runs in the primary instance for every launch, including ones forwarded
+// from other processes, so each launch gets a window in that launch's cwd.
+static int
+on_command_line(GApplication *app, GApplicationCommandLine *command_line, gpointer user_data)
+{
+    // Suppress unused parameter warning
+    (void)user_data;
     
-    g_free(shell);
-    g_strfreev(command_argv);  // This properly frees the array and its contents
+    GVariantDict *options = g_application_command_line_get_options_dict(command_line);
+    WindowSettings settings = { 0 };
+    gint64 scrollback_lines = config.scrollback_lines;
+    gint attach_id = 0;
+    const char *working_directory;
+    GtkWidget *window;
+    StartupTrace *trace = NULL;
     
-    // Start main loop
-    gtk_main();
+    if (g_variant_dict_contains(options, "startup-trace")) {
+        trace = g_new0(StartupTrace, 1);
+        trace->command_line = g_object_ref(command_line);
+        // A forwarded launch is timed from its arrival here
+        trace->start = g_application_command_line_get_is_remote(command_line) ?
+            g_get_monotonic_time() : process_start;
+    }
+    
+    g_variant_dict_lookup(options, "scrollback", "x", &scrollback_lines);
+    if (scrollback_lines < -1) {
+        g_application_command_line_printerr(command_line, "--scrollback must be -1 (unlimited) or at least 0\n");
+        return 1;
+    }
+    g_variant_dict_lookup(options, "attach", "i", &attach_id);
+    
+    settings.scrollback_lines = scrollback_lines;
+    settings.low_latency = g_variant_dict_contains(options, "low-latency");
+    settings.measure_latency = g_variant_dict_contains(options, "measure-latency");
+    // Coalescing holds frames back, which is the opposite of low latency
+    settings.coalesce_redraws = g_variant_dict_contains(options, "coalesce-redraws") && !settings.low_latency;
+    settings.use_sessions = g_variant_dict_contains(options, "sessions") || attach_id > 0;
+    settings.log_output = g_variant_dict_contains(options, "log");
+    settings.tap_output = settings.log_output || settings.low_latency || config.log_dir || config.triggers;
+    // The configured directory wins over the one vyn-terminal was started in
+    working_directory = config.cwd ? config.cwd : g_application_command_line_get_cwd(command_line);
+    window = create_window(GTK_APPLICATION(app), working_directory, &settings, MAX(attach_id, 0));
     
+    if (trace) {
+        VteTerminal *terminal = find_terminal(GTK_WIDGET(window_get_notebook(window)));
+        g_object_set_data_full(G_OBJECT(terminal), "vyn-trace", trace, startup_trace_free);
+        startup_trace(terminal, g_application_command_line_get_is_remote(command_line) ?
+                      "window created (forwarded to running instance)" : "window created");
+        g_signal_connect(window, "draw", G_CALLBACK(on_trace_draw), terminal);
+        if (!g_object_get_data(G_OBJECT(terminal), "vyn-prewarmed"))
+            g_signal_connect(terminal, "contents-changed", G_CALLBACK(on_trace_contents_changed), NULL);
+    }
+    
+    // Prewarm after the first window so it does not slow that window down
+    pool_schedule_refill();
     return 0;
 }
+
+int
+main(int argc, char *argv[])
+{
+    GtkApplication *app;
+    int status;
+    
+    process_start = g_get_monotonic_time();
+    
+    const GOptionEntry entries[] = {
+        { "scrollback", 's', 0, G_OPTION_ARG_INT64, NULL,
+          "Scrollback lines for new terminals, -1 for unlimited (default from config, else 10000)", "LINES" },
+        { "coalesce-redraws", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Limit repaints to the display refresh rate under heavy output", NULL },
+        { "sessions", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Run shells in the session daemon so they survive closing the window", NULL },
+        { "attach", 0, 0, G_OPTION_ARG_INT, NULL,
+          "Open a window attached to a detached session", "ID" },
+        { "list-sessions", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "List the session daemon's sessions, then exit", NULL },
+        { "daemon", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Run the session daemon (started automatically by --sessions)", NULL },
+        { "log", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Log terminal output from the start (Ctrl+Shift+L toggles)", NULL },
+        { "low-latency", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Favour input latency: no cursor blink or kinetic scrolling, shell output read ahead of redraws", NULL },
+        { "measure-latency", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Report keystroke-to-screen latency (p50/p99) per window", NULL },
+        { "startup-trace", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Report time to window and time to first prompt", NULL },
+        { "bench", 0, 0, G_OPTION_ARG_NONE, NULL,
+          "Measure output throughput and frame times, then exit", NULL },
+        { "bench-size", 0, 0, G_OPTION_ARG_INT, NULL,
+          "Megabytes generated per benchmark workload (default 32)", "MB" },
+        { NULL }
+    };
+    
+    app = gtk_application_new(APP_ID, G_APPLICATION_HANDLES_COMMAND_LINE);
+    g_application_add_main_option_entries(G_APPLICATION(app), entries);
+    g_signal_connect(app, "handle-local-options", G_CALLBACK(on_handle_local_options), NULL);
+    g_signal_connect(app, "startup", G_CALLBACK(on_startup), NULL);
+    g_signal_connect(app, "command-line", G_CALLBACK(on_command_line), NULL);
+    
+    // Start main loop; returns when the last window closes
+    status = g_application_run(G_APPLICATION(app), argc, argv);
+    g_object_unref(app);
+    tap_workers_wait();
+    
+    return status;
+}